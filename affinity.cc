@@ -0,0 +1,154 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* cpu and numa placement of threads and buffers
+ */
+
+#include "affinity.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cassert>
+#include "file.h"
+
+// parse a kernel style cpu list
+static bool parse_list(const char *str, std::vector<int> &cpus) {
+    const char *p = str;
+    while (*p != 0) {
+	char *end;
+	long first = strtol(p, &end, 10);
+	if ((end == p) || (first < 0)) return false;
+	long last = first;
+	p = end;
+	if (*p == '-') {
+	    ++p;
+	    last = strtol(p, &end, 10);
+	    if ((end == p) || (last < first)) return false;
+	    p = end;
+	}
+	for (long cpu = first; cpu <= last; ++cpu) {
+	    cpus.push_back(cpu);
+	}
+	if (*p == ',') {
+	    ++p;
+	} else if ((*p != 0) && (*p != '\n')) {
+	    return false;
+	} else {
+	    break;
+	}
+    }
+    return !cpus.empty();
+}
+
+// first line of a sysfs file
+static bool read_sysfs(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) return false;
+    bool res = fgets(buf, size, f) != nullptr;
+    fclose(f);
+    return res;
+}
+
+bool CPUList::parse(const char *str, int node) {
+    cpus_.clear();
+    if (strcmp(str, "node") == 0) {
+	if (node < 0) return false;
+	char path[64];
+	char buf[4096];
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/node/node%d/cpulist", node);
+	if (!read_sysfs(path, buf, sizeof(buf))) return false;
+	return parse_list(buf, cpus_);
+    }
+    return parse_list(str, cpus_);
+}
+
+int CPUList::cpu(int n) const {
+    if (cpus_.empty()) return -1;
+    return cpus_[n % cpus_.size()];
+}
+
+std::string CPUList::str() const {
+    if (cpus_.empty()) return "any";
+    std::string res;
+    for (size_t i = 0; i < cpus_.size(); ++i) {
+	if (i > 0) res += ",";
+	res += std::to_string(cpus_[i]);
+    }
+    return res;
+}
+
+static void pin(pthread_t thread, int cpu) {
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int res = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (res != 0) {
+	fprintf(stderr, "%s: can't pin to cpu %d: %s\n",
+		__PRETTY_FUNCTION__, cpu, strerror(res));
+    }
+}
+
+void pin_thread(std::thread &thread, int cpu) {
+    pin(thread.native_handle(), cpu);
+}
+
+void pin_thread(int cpu) {
+    pin(pthread_self(), cpu);
+}
+
+int device_node(const File &file) {
+    struct stat st;
+    int res = fstat(file.fd(), &st);
+    assert(res == 0);
+    // for plain files use the device of the filesystem
+    dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+    const char *fmt[] = {
+	"/sys/dev/block/%u:%u/device/numa_node",
+	// partitions
+	"/sys/dev/block/%u:%u/../device/numa_node",
+    };
+    for (const char *f : fmt) {
+	char path[128];
+	char buf[32];
+	snprintf(path, sizeof(path), f, major(dev), minor(dev));
+	if (read_sysfs(path, buf, sizeof(buf))) return atoi(buf);
+    }
+    return -1;
+}
+
+void bind_node(void *addr, size_t len, int node) {
+    if (node < 0) return;
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))] = { 0 };
+    assert(size_t(node) < 8 * sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |=
+	1UL << (node % (8 * sizeof(unsigned long)));
+    long res = syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask,
+		       8 * sizeof(mask), MPOL_MF_MOVE);
+    if (res != 0) {
+	perror(__PRETTY_FUNCTION__);
+    }
+}
@@ -0,0 +1,58 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* cpu and numa placement of threads and buffers
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H 1
+
+#include <thread>
+#include <vector>
+#include <string>
+
+class File;
+
+class CPUList {
+public:
+    // empty list, threads are not pinned
+    CPUList() { }
+
+    /* parse "0-3,8,10-11" or "node" for the cpus of node,
+     * returns false on error
+     */
+    bool parse(const char *str, int node);
+
+    bool empty() const { return cpus_.empty(); }
+    // n-th cpu, round robin, -1 if empty
+    int cpu(int n) const;
+    std::string str() const;
+private:
+    std::vector<int> cpus_;
+};
+
+// pin a thread to one cpu, -1 does nothing
+void pin_thread(std::thread &thread, int cpu);
+void pin_thread(int cpu);
+
+// numa node the device behind file is attached to, -1 if unknown
+int device_node(const File &file);
+
+// prefer memory from node for [addr, addr + len), -1 does nothing
+void bind_node(void *addr, size_t len, int node);
+
+#endif // #ifndef AFFINITY_H
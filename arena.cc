@@ -0,0 +1,126 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* one big buffer region shared by all IOCBs
+ */
+
+#include "arena.h"
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <cassert>
+#include "affinity.h"
+
+static const size_t DEFAULT_HUGEPAGE = 2 * 1024 * 1024;
+
+// size of MAP_HUGETLB pages
+static size_t hugepage_size() {
+    size_t size = DEFAULT_HUGEPAGE;
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (fp == nullptr) return size;
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+	unsigned long kb;
+	if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+	    size = kb * 1024;
+	    break;
+	}
+    }
+    fclose(fp);
+    return size;
+}
+
+static size_t round_up(size_t size, size_t align) {
+    return (size + align - 1) / align * align;
+}
+
+Arena::Arena(size_t size, Pages pages, bool lock, int node)
+    : base_(nullptr), size_(0), used_(0), pages_(pages), locked_(false) {
+    void *addr = MAP_FAILED;
+    if (pages_ == HUGETLB) {
+	size_ = round_up(size, hugepage_size());
+	addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (addr == MAP_FAILED) {
+	    fprintf(stderr, "Warning: no huge pages (%s), using THP\n",
+		    strerror(errno));
+	    pages_ = THP;
+	}
+    }
+    if (addr == MAP_FAILED) {
+	// THP only backs aligned huge pages, map extra and trim
+	size_t align = (pages_ == THP) ? DEFAULT_HUGEPAGE : size_t(ALIGN);
+	size_ = round_up(size, align);
+	size_t len = size_ + align - ALIGN;
+	addr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+	    fprintf(stderr, "%s: mmap(): %s\n", __PRETTY_FUNCTION__,
+		    strerror(errno));
+	    exit(1);
+	}
+	char *start = (char *)addr;
+	char *aligned = (char *)round_up(size_t(start), align);
+	if (aligned > start) munmap(start, aligned - start);
+	if (aligned + size_ < start + len) {
+	    munmap(aligned + size_, start + len - (aligned + size_));
+	}
+	addr = aligned;
+	if ((pages_ == THP)
+	    && (madvise(addr, size_, MADV_HUGEPAGE) != 0)) {
+	    fprintf(stderr, "Warning: madvise(MADV_HUGEPAGE): %s\n",
+		    strerror(errno));
+	    pages_ = SMALL;
+	}
+    }
+    base_ = (char *)addr;
+    // before anything is touched so pages come from the right node
+    bind_node(base_, size_, node);
+    if (lock) {
+	if (mlock(base_, size_) == 0) {
+	    locked_ = true;
+	} else {
+	    fprintf(stderr, "Warning: mlock(): %s\n", strerror(errno));
+	}
+    }
+}
+
+Arena::~Arena() {
+    munmap(base_, size_);
+}
+
+const char * Arena::name(Pages pages) {
+    switch (pages) {
+    case SMALL: return "small";
+    case THP: return "thp";
+    case HUGETLB: return "hugetlb";
+    }
+    assert(false);
+    return nullptr;
+}
+
+void * Arena::get(size_t size) {
+    size_t start = round_up(used_, ALIGN);
+    if (start + size > size_) {
+	fprintf(stderr, "%s: arena exhausted [%#lx + %#lx > %#lx]\n",
+		__PRETTY_FUNCTION__, start, size, size_);
+	assert(false);
+    }
+    used_ = start + size;
+    return base_ + start;
+}
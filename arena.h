@@ -0,0 +1,67 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* one big buffer region shared by all IOCBs
+ */
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <cstddef>
+
+/* Maps all buffer memory in one go and hands out slices of it. Nothing
+ * is ever freed individually: reset() makes the whole region available
+ * again (e.g. for the next phase) and the destructor unmaps it at once.
+ */
+class Arena {
+public:
+    enum Pages {
+	SMALL,		// normal pages
+	THP,		// ask for transparent huge pages
+	HUGETLB,	// MAP_HUGETLB, falls back to THP if none are free
+    };
+
+    enum {
+	ALIGN = 4096,	// alignment of slices, enough for O_DIRECT
+    };
+
+    // size bytes on numa node (-1 for any), optionally locked in RAM
+    Arena(size_t size, Pages pages, bool lock, int node);
+    ~Arena();
+
+    static const char * name(Pages pages);
+
+    // next size bytes, aligned to ALIGN
+    void * get(size_t size);
+    // forget all slices handed out so far
+    void reset() { used_ = 0; }
+
+    size_t size() const { return size_; }
+    // what we actually got, may be less than asked for
+    Pages pages() const { return pages_; }
+    bool locked() const { return locked_; }
+private:
+    Arena(Arena &&) = delete;
+    Arena & operator =(Arena &&) = delete;
+
+    char *base_;
+    size_t size_;
+    size_t used_;
+    Pages pages_;
+    bool locked_;
+};
+
+#endif // #ifndef ARENA_H
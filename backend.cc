@@ -0,0 +1,96 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* interface for async IO backends
+ */
+
+#include "backend.h"
+#include "context.h"
+#include "uring.h"
+#include "iocb.h"
+#include "clock.h"
+#include <cassert>
+
+Backend * Backend::create(Kind kind, int max_events, int flags) {
+    switch (kind) {
+    case AIO:
+	assert(flags == 0);
+	return new Context(max_events);
+    case URING:
+	return new URing(max_events, flags);
+    }
+    assert(false);
+    return nullptr;
+}
+
+const char * Backend::name(Kind kind) {
+    switch (kind) {
+    case AIO: return "aio";
+    case URING: return "uring";
+    }
+    assert(false);
+    return nullptr;
+}
+
+Backend::~Backend() { }
+
+/* Buffers carved back to back from an arena are registered as a few
+ * big iovecs instead of one per IOCB. The kernel limits each iovec to
+ * 1GiB.
+ */
+void Backend::register_buffers(const std::vector<IOCB *> & iocbs) {
+    std::vector<struct iovec> iov;
+    std::vector<int> index(iocbs.size());
+    for (size_t i = 0; i < iocbs.size(); ++i) {
+	char *buf = (char *)iocbs[i]->buf();
+	if (!iov.empty()) {
+	    struct iovec &last = iov.back();
+	    if ((buf == (char *)last.iov_base + last.iov_len)
+		&& (last.iov_len + iocbs[i]->size() <= MAX_IOVEC)) {
+		last.iov_len += iocbs[i]->size();
+		index[i] = iov.size() - 1;
+		continue;
+	    }
+	}
+	iov.push_back((struct iovec){ buf, iocbs[i]->size() });
+	index[i] = iov.size() - 1;
+    }
+    if (!register_iovec(iov.data(), iov.size())) return;
+    for (size_t i = 0; i < iocbs.size(); ++i) {
+	iocbs[i]->buf_index(index[i]);
+    }
+}
+
+int Backend::reap(int min_nr, int nr, IOCB *iocbs[], uint64_t timeout,
+		  int spin, uint64_t &sleeps) {
+    if ((spin > 0) && !polled()) {
+	uint64_t spin_until = now_ns() + spin * 1000ULL;
+	do {
+	    int res = getevents(0, nr, iocbs, 0);
+	    if (res > 0) return res;
+	} while (now_ns() < spin_until);
+	if (min_nr == 0) return 0;
+    }
+    if (min_nr > 0) ++sleeps;
+    return getevents(min_nr, nr, iocbs, timeout);
+}
+
+void Backend::register_file(int) { }
+
+bool Backend::register_iovec(const struct iovec *, int) {
+    return false;
+}
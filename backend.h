@@ -0,0 +1,90 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* interface for async IO backends
+ */
+
+#ifndef BACKEND_H
+#define BACKEND_H 1
+
+#include <sys/uio.h>
+#include <vector>
+#include <cstdint>
+
+class IOCB;
+
+class Backend {
+public:
+    enum Kind {
+	AIO,
+	URING,
+    };
+
+    enum Flags {
+	SQPOLL = 1 << 0,
+	IOPOLL = 1 << 1,
+    };
+
+    static Backend * create(Kind kind, int max_events, int flags);
+    static const char * name(Kind kind);
+
+    virtual ~Backend();
+    int max_events() const { return max_events_; }
+
+    /* Optional: memory and file used by all requests, before the
+     * first submit. IOCBs get their buffer index set if the backend
+     * makes use of it.
+     */
+    void register_buffers(const std::vector<IOCB *> & iocbs);
+    virtual void register_file(int fd);
+
+    // signal completions on eventfd
+    virtual void set_eventfd(int efd) = 0;
+    virtual void submit(int nr, IOCB *iocbs[]) = 0;
+    /* reap between min_nr and nr completions, sets the result of each
+     * IOCB; completions are only found by polling if polled(). Gives
+     * up waiting for min_nr after timeout ns unless it is 0.
+     */
+    virtual int getevents(int min_nr, int nr, IOCB *iocbs[],
+			  uint64_t timeout) = 0;
+    /* getevents() that first polls up to spin us for completions if
+     * none are ready, then blocks only if min_nr > 0 and counts that
+     * in sleeps
+     */
+    int reap(int min_nr, int nr, IOCB *iocbs[], uint64_t timeout, int spin,
+	     uint64_t &sleeps);
+    /* ask the kernel to give up on a request in flight, it still comes
+     * back through getevents(), with -ECANCELED if the cancel worked;
+     * false if it can't be cancelled at all
+     */
+    virtual bool cancel(IOCB *iocb) = 0;
+    virtual bool polled() const { return false; }
+protected:
+    enum {
+	MAX_IOVEC = 1 << 30,	// largest registered buffer
+    };
+
+    Backend(int max_events) : max_events_(max_events) { }
+    virtual bool register_iovec(const struct iovec *iov, int nr);
+private:
+    Backend(Backend &&) = delete;
+    Backend & operator =(Backend &&) = delete;
+
+    int max_events_;
+};
+
+#endif // #ifndef BACKEND_H
@@ -0,0 +1,92 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* bad sectors found by retrying failed requests
+ */
+
+#include "badblocks.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "file.h"
+#include "iocb.h"
+#include "extents.h"
+#include "generator.h"
+
+BadBlocks::BadBlocks(File &file, int retries, Extents &extents)
+    : file_(file), sector_(file.sector_size()), retries_(retries),
+      extents_(extents), failed_(0), bad_(0) { }
+
+void BadBlocks::retry(IOCB *iocb) {
+    failed_.fetch_add(1, std::memory_order_relaxed);
+    bool write = (iocb->kind() == IOCB::WRITE);
+    long res = iocb->result();
+    fprintf(stderr, "%s error at %#lx: %s, retrying\n",
+	    write ? "Write" : "Read", iocb->offset(),
+	    (res < 0) ? strerror(-res) : "short transfer");
+    char *buf = (char *)iocb->buf();
+    Ranges good;
+    uint64_t bad = probe(write, buf, iocb->offset(), iocb->size(), good);
+    if (bad == 0) {
+	iocb->result(iocb->size());
+	return;
+    }
+    // IOCB::check() skips the block as a whole, the rest can be wrong too
+    Generator *gen = iocb->gen();
+    if (write || (gen == nullptr)) return;
+    for (const std::pair<off_t, off_t> &range : good) {
+	gen->check(buf + (range.first - iocb->offset()),
+		   range.second - range.first, range.first);
+    }
+}
+
+BadBlocks::Counts BadBlocks::counts() {
+    Counts counts;
+    counts.failed = failed_.exchange(0);
+    counts.bad = bad_.exchange(0);
+    return counts;
+}
+
+uint64_t BadBlocks::probe(bool write, char *buf, off_t offset,
+			  size_t size, Ranges &good) {
+    for (int i = 0; i <= retries_; ++i) {
+	if (transfer(write, buf, offset, size)) {
+	    // merged with the part before unless a bad sector is between
+	    if (!good.empty() && (good.back().second == offset)) {
+		good.back().second = offset + size;
+	    } else {
+		good.push_back(std::make_pair(offset, offset + size));
+	    }
+	    return 0;
+	}
+    }
+    if (size < 2 * sector_) {
+	bad_.fetch_add(1, std::memory_order_relaxed);
+	extents_.add(Extents::IO, offset, size);
+	return 1;
+    }
+    size_t half = size / sector_ / 2 * sector_;
+    return probe(write, buf, offset, half, good)
+	+ probe(write, buf + half, offset + half, size - half, good);
+}
+
+bool BadBlocks::transfer(bool write, char *buf, off_t offset,
+			 size_t size) {
+    ssize_t res = write ? pwrite(file_.fd(), buf, size, offset)
+	: pread(file_.fd(), buf, size, offset);
+    return res == ssize_t(size);
+}
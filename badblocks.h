@@ -0,0 +1,81 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* bad sectors found by retrying failed requests
+ */
+
+#ifndef BADBLOCKS_H
+#define BADBLOCKS_H 1
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class File;
+class IOCB;
+class Extents;
+
+/* A request that failed or came back short is retried with small
+ * synchronous requests, bisected down to the logical block size of
+ * the device. Sectors that still fail after all retries are added to
+ * the extents, the data of a read that did transfer is still checked.
+ * retry() may be called from many threads at once.
+ */
+class BadBlocks {
+public:
+    BadBlocks(File &file, int retries, Extents &extents);
+
+    size_t sector_size() const { return sector_; }
+
+    /* redo the failed request, sets its result to the full size if
+     * every sector succeeded in the end, otherwise checks the parts of
+     * a read that did with the request's generator
+     */
+    void retry(IOCB *iocb);
+
+    struct Counts {
+	uint64_t failed;	// requests
+	uint64_t bad;		// sectors
+    };
+
+    // counted since the last call
+    Counts counts();
+private:
+    BadBlocks(BadBlocks &&) = delete;
+    BadBlocks & operator =(BadBlocks &&) = delete;
+
+    // start -> end of the parts of a request that transferred
+    typedef std::vector<std::pair<off_t, off_t> > Ranges;
+
+    /* number of bad sectors in [offset, offset + size), adds the parts
+     * that transferred to good
+     */
+    uint64_t probe(bool write, char *buf, off_t offset, size_t size,
+		   Ranges &good);
+    bool transfer(bool write, char *buf, off_t offset, size_t size);
+
+    File &file_;
+    size_t sector_;
+    int retries_;
+    Extents &extents_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<uint64_t> bad_;
+};
+
+#endif // #ifndef BADBLOCKS_H
@@ -22,14 +22,46 @@
 #include <stdio.h>
 #include <errno.h>
 #include <cassert>
+#include <algorithm>
+#include "iocb.h"
 
-Context::Context(int max_events) : ctx_(0), max_events_(max_events) {
+/* The kernel maps the completion ring into user space and io_context_t
+ * points at it. Completions can be consumed from there without a
+ * syscall as long as we are the only consumer.
+ */
+struct aio_ring {
+    unsigned id;
+    unsigned nr;
+    unsigned head;
+    unsigned tail;
+    unsigned magic;
+    unsigned compat_features;
+    unsigned incompat_features;
+    unsigned header_length;
+    struct io_event io_events[0];
+};
+
+enum {
+    AIO_RING_MAGIC = 0xa10a10a1,
+};
+
+static IOCB * complete(const struct io_event &event) {
+    IOCB * iocb = IOCB::iocb(event.obj);
+    iocb->result((event.res2 != 0) ? -EIO : long(event.res));
+    return iocb;
+}
+
+Context::Context(int max_events)
+    : Backend(max_events), ctx_(0), efd_(-1), user_ring_(false) {
     int res = io_queue_init(max_events, &ctx_);
     if (res < 0) {
 	fprintf(stderr, "%s: io_queue_init(): %s\n",
 		__PRETTY_FUNCTION__, strerror(-res));
 	assert(false);
     }
+    struct aio_ring *ring = (struct aio_ring *)ctx_;
+    user_ring_ = (ring->magic == AIO_RING_MAGIC)
+	&& (ring->incompat_features == 0);
 }
 
 Context::~Context() {
@@ -41,14 +73,83 @@ Context::~Context() {
     }
 }
 
+void Context::set_eventfd(int efd) {
+    efd_ = efd;
+}
+
+void Context::submit(int nr, IOCB *iocbs[]) {
+    struct iocb *iocbp[nr];
+    for (int i = 0; i < nr; ++i) {
+	iocbp[i] = iocbs[i]->iocb();
+	if (efd_ != -1) io_set_eventfd(iocbp[i], efd_);
+    }
+    submit(nr, iocbp);
+}
+
+int Context::getevents(int min_nr, int nr, IOCB *iocbs[],
+		       uint64_t timeout) {
+    int num = 0;
+    while (!rejected_.empty() && (num < nr)) {
+	iocbs[num++] = rejected_.back();
+	rejected_.pop_back();
+    }
+    if (num == nr) return num;
+    if (user_ring_) {
+	num += reap_ring(nr - num, iocbs + num);
+	if (num >= min_nr) return num;
+    }
+    struct io_event event[nr - num];
+    // don't sleep if nothing is required
+    int need = std::max(min_nr - num, 0);
+    if (need == 0) timeout = 0;
+    struct timespec limit = {
+	time_t(timeout / 1000000000), long(timeout % 1000000000)
+    };
+    bool forever = (need > 0) && (timeout == 0);
+    int res = getevents(need, nr - num, event, forever ? nullptr : &limit);
+    for (int i = 0; i < res; ++i) {
+	iocbs[num++] = complete(event[i]);
+    }
+    return num;
+}
+
+bool Context::cancel(IOCB *iocb) {
+    struct io_event event;
+    int res = io_cancel(ctx_, iocb->submitted(), &event);
+    if (res == 0) {
+	// older kernels hand the completion back right here
+	rejected_.push_back(complete(event));
+	return true;
+    }
+    // otherwise it completes through the ring, most requests can't be
+    return res == -EINPROGRESS;
+}
+
+int Context::reap_ring(int nr, IOCB *iocbs[]) {
+    struct aio_ring *ring = (struct aio_ring *)ctx_;
+    unsigned head = ring->head;
+    unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    int num = 0;
+    while ((head != tail) && (num < nr)) {
+	iocbs[num++] = complete(ring->io_events[head]);
+	head = (head + 1) % ring->nr;
+    }
+    if (num > 0) __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    return num;
+}
+
 void Context::submit(int nr, struct iocb *iocbp[]) {
     int done = 0;
     while (done < nr) {
 	int res = io_submit(ctx_, nr - done, &iocbp[done]);
+	if ((res == -EAGAIN) || (res == -EINTR)) continue;
 	if (res < 0) {
-	    fprintf(stderr, "%s: io_submit(): %s\n",
-		    __PRETTY_FUNCTION__, strerror(-res));
-	    assert(false);
+	    // the first request is bad, fail it and go on with the rest
+	    IOCB * iocb = IOCB::iocb(iocbp[done]);
+	    iocb->result(res);
+	    rejected_.push_back(iocb);
+	    ++done;
+	    continue;
 	}
 	done += res;
 	if (done != nr) {
@@ -58,11 +159,14 @@ void Context::submit(int nr, struct iocb *iocbp[]) {
     }
 }
 
-int Context::getevents(int min_nr, int nr, struct io_event *events) {
+int Context::getevents(int min_nr, int nr, struct io_event *events,
+		       struct timespec *timeout) {
     while (true) {
-	int res = io_getevents(ctx_, min_nr, nr, events, nullptr);
+	int res = io_getevents(ctx_, min_nr, nr, events, timeout);
 	if (res < 0) {
-	    if (errno == EINTR) continue;
+	    // with a timeout the caller can cope with less and wait again
+	    if ((res == -EINTR) && (timeout != nullptr)) return 0;
+	    if (res == -EINTR) continue;
 	    fprintf(stderr, "%s: io_getevents(): %s\n",
 		    __PRETTY_FUNCTION__, strerror(-res));
 	    assert(false);
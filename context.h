@@ -22,17 +22,31 @@
 #define CONTEXT_H 1
 
 #include <libaio.h>
+#include <vector>
+#include "backend.h"
 
-class Context {
+class Context : public Backend {
 public:
     Context(int max_events);
     ~Context();
-    int max_events() const { return max_events_; }
-    void submit(int nr, struct iocb *iocbp[]);
-    int getevents(int min_nr, int nr, struct io_event *events);
+    void set_eventfd(int efd);
+    void submit(int nr, IOCB *iocbs[]);
+    int getevents(int min_nr, int nr, IOCB *iocbs[], uint64_t timeout);
+    bool cancel(IOCB *iocb);
 private:
+    int reap_ring(int nr, IOCB *iocbs[]);
+    void submit(int nr, struct iocb *iocbp[]);
+    int getevents(int min_nr, int nr, struct io_event *events,
+		  struct timespec *timeout);
+
     io_context_t ctx_;
-    int max_events_;
+    int efd_;
+    // completions can be read from the mmap()ed ring behind ctx_
+    bool user_ring_;
+    /* refused by io_submit() or cancelled right away, handed out by the
+     * next getevents()
+     */
+    std::vector<IOCB *> rejected_;
 };
 
 #endif // #ifndef CONTEXT_H
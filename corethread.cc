@@ -0,0 +1,181 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* thread owning a slice of the device end to end
+ */
+
+#include "corethread.h"
+#include <stdio.h>
+#include <algorithm>
+#include "clock.h"
+#include "file.h"
+#include "affinity.h"
+
+CoreThread::CoreThread(File &file, Watchdog &watchdog, Backend *backend,
+		       int num_iocb, size_t blocksize, int batch, int spin,
+		       int cpu, char *buf, WriteRing<IOCB> failed,
+		       ReadRing<IOCB> retried, EventFD &done)
+    : file_(file), kind_(IOCB::READ), gen_(nullptr), regions_(nullptr),
+      backend_(backend),
+      num_iocb_(num_iocb), blocksize_(blocksize),
+      batch_(std::min(batch, backend->max_events())),
+      spin_(spin), shard_(Shard::STRIPE, 0, 1, 0, blocksize), cpu_(cpu),
+      buf_(buf), failed_(std::move(failed)), retried_(std::move(retried)),
+      done_(done), stop_(false), stats_(),
+      inflight_(watchdog, backend), completed_(0),
+      thread_(&CoreThread::run, this) {
+    assert(batch_ > 0);
+}
+
+CoreThread::~CoreThread() {
+    stop_ = true;
+    start_.write(1);
+    thread_.join();
+    delete backend_;
+}
+
+void CoreThread::start(IOCB::Kind kind, Generator *gen, const Shard &shard,
+		       Regions &regions) {
+    kind_ = kind;
+    gen_ = gen;
+    shard_ = shard;
+    regions_ = &regions;
+    stats_ = Stats();
+    latency_ = Latency();
+    histogram_ = Histogram();
+    completed_.store(0, std::memory_order_relaxed);
+    start_.write(1);
+}
+
+void CoreThread::run(void) {
+    pin_thread(cpu_);
+    std::vector<IOCB *> free;
+    for (int i = 0; i < num_iocb_; ++i) {
+	free.push_back(new IOCB(file_, kind_, gen_, buf_ + i * blocksize_,
+				blocksize_));
+    }
+    backend_->register_file(file_.fd());
+    backend_->register_buffers(free);
+
+    while (true) {
+	start_.read();
+	if (stop_) break;
+	pass(free);
+	done_.write(1);
+    }
+
+    failed_.close();
+    for (IOCB * iocb : free) {
+	delete iocb;
+    }
+}
+
+// one pass over shard_, returns with all IOCBs back in free
+void CoreThread::pass(std::vector<IOCB *> &free) {
+    for (IOCB * iocb : free) {
+	iocb->kind(kind_);
+	iocb->gen(gen_);
+    }
+    int max_events = backend_->max_events();
+    int pending = 0;
+    // failed requests out with the RetryWorker
+    uint64_t retrying = 0;
+    uint64_t next = 0;
+    IOCB * iocbs[max_events];
+
+    while (true) {
+	if (retrying > 0) {
+	    retrying -= take_retried(iocbs, max_events, false, free);
+	}
+
+	// fill and submit up to batch_ blocks
+	int num = 0;
+	while ((num < batch_) && (pending + num < max_events)
+	       && !free.empty() && (next < shard_.blocks())) {
+	    IOCB * iocb = free.back();
+	    free.pop_back();
+	    iocb->offset(shard_.offset(next++));
+	    iocb->fill();
+	    iocbs[num++] = iocb;
+	}
+	if (num > 0) {
+	    uint64_t now = now_ns();
+	    for (int i = 0; i < num; ++i) {
+		iocbs[i]->started(now);
+		inflight_.add(iocbs[i]);
+	    }
+	    backend_->submit(num, iocbs);
+	    pending += num;
+	    ++stats_.submit_calls;
+	    stats_.submitted += num;
+	}
+	if (pending == 0) {
+	    if (retrying == 0) break;
+	    // nothing else to wait for
+	    retrying -= take_retried(iocbs, max_events, true, free);
+	    continue;
+	}
+
+	// only spin and block if nothing more can be submitted
+	bool more = (pending < max_events) && !free.empty()
+	    && (next < shard_.blocks());
+	int res = more ? backend_->getevents(0, pending, iocbs, 0)
+	    : backend_->reap(1, pending, iocbs, inflight_.check(now_ns()),
+			     spin_, stats_.sleeps);
+	if (res == 0) continue;
+	pending -= res;
+	++stats_.reap_calls;
+	stats_.reaped += res;
+	uint64_t bytes = 0;
+	uint64_t now = now_ns();
+	for (int i = 0; i < res; ++i) {
+	    IOCB * iocb = iocbs[i];
+	    iocb->finished(now);
+	    inflight_.remove(iocb);
+	    latency_.add(iocb->latency(), iocb->size());
+	    histogram_.add(iocb->latency());
+	    regions_->add(iocb->offset(), iocb->started(), now, iocb->size());
+	    if (iocb->result() != long(iocb->size())) {
+		// bisecting it here would hold up the healthy ones
+		failed_.write(iocb);
+		++retrying;
+		continue;
+	    }
+	    // verify while the buffer is still in cache
+	    iocb->check();
+	    bytes += iocb->size();
+	    free.push_back(iocb);
+	}
+	completed_.fetch_add(bytes, std::memory_order_relaxed);
+	inflight_.check(now);
+    }
+}
+
+// check and free what came back from the retry, returns how many did
+uint64_t CoreThread::take_retried(IOCB *iocbs[], size_t max, bool block,
+				  std::vector<IOCB *> &free) {
+    size_t num = block ? retried_.read_batch(iocbs, max)
+	: retried_.try_read_batch(iocbs, max);
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < num; ++i) {
+	iocbs[i]->check();
+	bytes += iocbs[i]->size();
+	free.push_back(iocbs[i]);
+    }
+    completed_.fetch_add(bytes, std::memory_order_relaxed);
+    return num;
+}
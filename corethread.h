@@ -0,0 +1,112 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* thread owning a slice of the device end to end
+ */
+
+#ifndef CORETHREAD_H
+#define CORETHREAD_H 1
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include "backend.h"
+#include "eventfd.h"
+#include "iocb.h"
+#include "iothread.h"
+#include "ring.h"
+#include "shard.h"
+#include "latency.h"
+#include "regions.h"
+#include "watchdog.h"
+
+class File;
+class Generator;
+class BadBlocks;
+
+/* Fills, submits, reaps and checks its own IOCBs without handing them
+ * to other threads, only failed ones are retried by a RetryWorker while
+ * the rest goes on. The buffers are first touched by the thread itself
+ * so unless the arena is bound or locked they are local to the core it
+ * runs on. Thread, backend and buffers stay for all passes, start()
+ * hands it the next one.
+ */
+class CoreThread {
+public:
+    using Stats = IOThread::Stats;
+
+    /* takes ownership of backend, signals done when a pass is
+     * finished, spins up to spin us for completions before sleeping,
+     * runs on cpu and uses num_iocb * blocksize bytes at buf for
+     * buffers, requests that fail or come back short go to failed and
+     * are expected back on retried once a RetryWorker is done with
+     * them, requests in flight are watched by watchdog
+     */
+    CoreThread(File &file, Watchdog &watchdog, Backend *backend,
+	       int num_iocb, size_t blocksize, int batch, int spin, int cpu,
+	       char *buf, WriteRing<IOCB> failed, ReadRing<IOCB> retried,
+	       EventFD &done);
+    ~CoreThread();
+
+    /* one pass over shard, filled and checked by gen unless it is
+     * nullptr, completions are added to regions, only between passes
+     */
+    void start(IOCB::Kind kind, Generator *gen, const Shard &shard,
+	       Regions &regions);
+    // bytes completed so far in this pass
+    uint64_t completed() const {
+	return completed_.load(std::memory_order_relaxed);
+    }
+    // of the last pass, only valid once done was signaled
+    const Stats & stats() const { return stats_; }
+    const Latency & latency() const { return latency_; }
+    const Histogram & histogram() const { return histogram_; }
+private:
+    CoreThread(CoreThread &&) = delete;
+    CoreThread & operator =(CoreThread &&) = delete;
+    void run(void);
+    void pass(std::vector<IOCB *> &free);
+    uint64_t take_retried(IOCB *iocbs[], size_t max, bool block,
+			  std::vector<IOCB *> &free);
+
+    File &file_;
+    IOCB::Kind kind_;
+    Generator *gen_;
+    Regions *regions_;
+    Backend *backend_;
+    int num_iocb_;
+    size_t blocksize_;
+    int batch_;
+    int spin_;
+    Shard shard_;
+    int cpu_;
+    char *buf_;
+    WriteRing<IOCB> failed_;
+    ReadRing<IOCB> retried_;
+    EventFD &done_;
+    // a pass was handed over, or stop_ if none will come
+    EventFD start_;
+    bool stop_;
+    Stats stats_;
+    InFlight inflight_;
+    Latency latency_;
+    Histogram histogram_;
+    std::atomic<uint64_t> completed_;
+    std::thread thread_;
+};
+
+#endif // #ifndef CORETHREAD_H
@@ -0,0 +1,195 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* crc32c (Castagnoli) checksums
+ */
+
+#include "crc32c.h"
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+static const uint32_t POLY = 0x82f63b78; // reversed Castagnoli
+
+// slicing by 8 tables
+struct Tables {
+    uint32_t t[8][256];
+
+    Tables() {
+	for (uint32_t i = 0; i < 256; ++i) {
+	    uint32_t c = i;
+	    for (int k = 0; k < 8; ++k) c = (c >> 1) ^ ((c & 1) ? POLY : 0);
+	    t[0][i] = c;
+	}
+	for (uint32_t i = 0; i < 256; ++i) {
+	    for (int k = 1; k < 8; ++k) {
+		t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+	    }
+	}
+    }
+};
+
+static const Tables tables;
+
+static uint32_t update_soft(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    const uint32_t (&t)[8][256] = tables.t;
+    while (len >= 8) {
+	uint64_t w;
+	memcpy(&w, p, sizeof(w));
+	w ^= crc;
+	crc = t[7][w & 0xff] ^ t[6][(w >> 8) & 0xff]
+	    ^ t[5][(w >> 16) & 0xff] ^ t[4][(w >> 24) & 0xff]
+	    ^ t[3][(w >> 32) & 0xff] ^ t[2][(w >> 40) & 0xff]
+	    ^ t[1][(w >> 48) & 0xff] ^ t[0][w >> 56];
+	p += 8;
+	len -= 8;
+    }
+    while (len-- > 0) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+static void blocks_soft(const void *buf, size_t num, size_t stride,
+			size_t len, uint32_t *crc) {
+    const char *p = (const char *)buf;
+    for (size_t i = 0; i < num; ++i) {
+	crc[i] = ~update_soft(~0U, p + i * stride, len);
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t update_sse42(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t c = crc;
+    while (len >= 8) {
+	uint64_t w;
+	memcpy(&w, p, sizeof(w));
+	c = _mm_crc32_u64(c, w);
+	p += 8;
+	len -= 8;
+    }
+    crc = c;
+    while (len-- > 0) crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+// 4 independent chains keep the crc unit busy
+__attribute__((target("sse4.2")))
+static void blocks_sse42(const void *buf, size_t num, size_t stride,
+			 size_t len, uint32_t *crc) {
+    const char *p = (const char *)buf;
+    size_t words = len / 8;
+    size_t i = 0;
+    for (; i + 4 <= num; i += 4) {
+	const char *p0 = p + i * stride;
+	const char *p1 = p0 + stride;
+	const char *p2 = p1 + stride;
+	const char *p3 = p2 + stride;
+	uint64_t c0 = ~0U, c1 = ~0U, c2 = ~0U, c3 = ~0U;
+	for (size_t k = 0; k < words * 8; k += 8) {
+	    uint64_t w0, w1, w2, w3;
+	    memcpy(&w0, p0 + k, 8);
+	    memcpy(&w1, p1 + k, 8);
+	    memcpy(&w2, p2 + k, 8);
+	    memcpy(&w3, p3 + k, 8);
+	    c0 = _mm_crc32_u64(c0, w0);
+	    c1 = _mm_crc32_u64(c1, w1);
+	    c2 = _mm_crc32_u64(c2, w2);
+	    c3 = _mm_crc32_u64(c3, w3);
+	}
+	size_t tail = len - words * 8;
+	crc[i] = ~update_sse42(c0, p0 + words * 8, tail);
+	crc[i + 1] = ~update_sse42(c1, p1 + words * 8, tail);
+	crc[i + 2] = ~update_sse42(c2, p2 + words * 8, tail);
+	crc[i + 3] = ~update_sse42(c3, p3 + words * 8, tail);
+    }
+    for (; i < num; ++i) {
+	crc[i] = ~update_sse42(~0U, p + i * stride, len);
+    }
+}
+#endif // #if defined(__x86_64__)
+
+#if defined(__aarch64__)
+__attribute__((target("+crc")))
+static uint32_t update_armv8(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    while (len >= 8) {
+	uint64_t w;
+	memcpy(&w, p, sizeof(w));
+	crc = __crc32cd(crc, w);
+	p += 8;
+	len -= 8;
+    }
+    while (len-- > 0) crc = __crc32cb(crc, *p++);
+    return crc;
+}
+
+__attribute__((target("+crc")))
+static void blocks_armv8(const void *buf, size_t num, size_t stride,
+			 size_t len, uint32_t *crc) {
+    const char *p = (const char *)buf;
+    for (size_t i = 0; i < num; ++i) {
+	crc[i] = ~update_armv8(~0U, p + i * stride, len);
+    }
+}
+#endif // #if defined(__aarch64__)
+
+struct Impl {
+    const char *name;
+    uint32_t (*update)(uint32_t crc, const void *buf, size_t len);
+    void (*blocks)(const void *buf, size_t num, size_t stride, size_t len,
+		   uint32_t *crc);
+};
+
+static Impl pick() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+	return { "sse4.2", update_sse42, blocks_sse42 };
+    }
+#endif
+#if defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+	return { "armv8", update_armv8, blocks_armv8 };
+    }
+#endif
+    return { "soft", update_soft, blocks_soft };
+}
+
+static const Impl & impl() {
+    static const Impl best = pick();
+    return best;
+}
+
+uint32_t crc32c(const void *buf, size_t len) {
+    return ~impl().update(~0U, buf, len);
+}
+
+void crc32c_blocks(const void *buf, size_t num, size_t stride, size_t len,
+		   uint32_t *crc) {
+    impl().blocks(buf, num, stride, len, crc);
+}
+
+const char * crc32c_name() {
+    return impl().name;
+}
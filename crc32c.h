@@ -0,0 +1,42 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* crc32c (Castagnoli) checksums
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H 1
+
+#include <cstddef>
+#include <cstdint>
+
+/* Uses the SSE4.2 or ARMv8 crc instructions when the cpu has them and
+ * a table driven version otherwise, picked at runtime.
+ */
+
+// crc32c of len bytes at buf
+uint32_t crc32c(const void *buf, size_t len);
+
+/* crc32c of the first len bytes of num blocks stride bytes apart;
+ * several blocks are summed at once to hide the instruction latency
+ */
+void crc32c_blocks(const void *buf, size_t num, size_t stride, size_t len,
+		   uint32_t *crc);
+
+// name of the implementation in use
+const char * crc32c_name();
+
+#endif // #ifndef CRC32C_H
@@ -23,7 +23,7 @@
 #include <utility>
 #include <cassert>
 
-EventFD::EventFD() : FD(eventfd(0, EFD_CLOEXEC)) { }
+EventFD::EventFD(int flags) : FD(eventfd(0, EFD_CLOEXEC | flags)) { }
 
 EventFD::EventFD(EventFD && other) : FD(std::move(other)) { }
 
@@ -26,7 +26,7 @@
 
 class EventFD : public FD {
 public:
-    EventFD();
+    explicit EventFD(int flags = 0);
     EventFD(EventFD && other);
     ~EventFD();
     EventFD & operator = (EventFD && other);
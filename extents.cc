@@ -0,0 +1,112 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* bad parts of the device merged into extents
+ */
+
+#include "extents.h"
+#include <stdio.h>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <cassert>
+
+const char * Extents::name(Kind kind) {
+    switch (kind) {
+    case IO: return "io error";
+    case CORRUPT: return "corrupt";
+    case MISDIRECTED: return "misdirected";
+    case STALE: return "stale";
+    case TORN: return "torn";
+    case KINDS: break;
+    }
+    assert(false);
+    return nullptr;
+}
+
+void Extents::add(Kind kind, off_t offset, off_t size) {
+    assert(size > 0);
+    off_t start = offset;
+    off_t end = offset + size;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<off_t, off_t> &map = map_[kind];
+    // swallow the extent before if it reaches us, then all after
+    auto it = map.upper_bound(start);
+    if ((it != map.begin()) && (std::prev(it)->second >= start)) {
+	--it;
+	start = it->first;
+	end = std::max(end, it->second);
+	it = map.erase(it);
+    }
+    while ((it != map.end()) && (it->first <= end)) {
+	end = std::max(end, it->second);
+	it = map.erase(it);
+    }
+    map.emplace_hint(it, start, end);
+}
+
+void Extents::print(size_t max) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // (start, end, kind) of everything, by offset
+    std::vector<std::tuple<off_t, off_t, int> > all;
+    uint64_t bytes[KINDS] = { };
+    uint64_t total = 0;
+    for (int k = 0; k < KINDS; ++k) {
+	for (const std::pair<const off_t, off_t> &e : map_[k]) {
+	    bytes[k] += e.second - e.first;
+	    all.emplace_back(e.first, e.second, k);
+	}
+	total += bytes[k];
+    }
+    printf("bad extents = %zu, %#lx bytes\n", all.size(), total);
+    for (int k = 0; k < KINDS; ++k) {
+	if (map_[k].empty()) continue;
+	printf("    %-11s %zu extents, %#lx bytes\n", name(Kind(k)),
+	       map_[k].size(), bytes[k]);
+    }
+    std::sort(all.begin(), all.end());
+    for (size_t i = 0; (i < all.size()) && (i < max); ++i) {
+	printf("    %#lx - %#lx %s\n", std::get<0>(all[i]),
+	       std::get<1>(all[i]) - 1, name(Kind(std::get<2>(all[i]))));
+    }
+    if (all.size() > max) printf("    ... %zu more\n", all.size() - max);
+}
+
+bool Extents::write_list(const char *path, size_t unit) const {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) return false;
+    std::vector<std::pair<off_t, off_t> > all;
+    {
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (const std::map<off_t, off_t> &map : map_) {
+	    all.insert(all.end(), map.begin(), map.end());
+	}
+    }
+    std::sort(all.begin(), all.end());
+    // kinds may overlap, print each block once
+    uint64_t next = 0;
+    for (const std::pair<off_t, off_t> &e : all) {
+	uint64_t last = (e.second - 1) / unit;
+	for (uint64_t block = std::max(next, e.first / unit); block <= last;
+	     ++block) {
+	    fprintf(file, "%lu\n", block);
+	}
+	next = std::max(next, last + 1);
+    }
+    bool ok = !ferror(file);
+    return (fclose(file) == 0) && ok;
+}
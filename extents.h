@@ -0,0 +1,70 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* bad parts of the device merged into extents
+ */
+
+#ifndef EXTENTS_H
+#define EXTENTS_H 1
+
+#include <sys/types.h>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+/* Byte ranges of the device found bad, by what was wrong with them.
+ * Adjacent or overlapping ranges of the same kind are merged so a dead
+ * region costs one entry however many sectors it has. add() may be
+ * called from many threads at once, but is only called when something
+ * is wrong so a mutex will do.
+ */
+class Extents {
+public:
+    enum Kind {
+	IO,		// read or write failed after all retries
+	CORRUPT,	// see Generator
+	MISDIRECTED,
+	STALE,
+	TORN,		// whole blocks
+	KINDS,
+    };
+
+    Extents() { }
+
+    static const char * name(Kind kind);
+
+    void add(Kind kind, off_t offset, off_t size);
+
+    /* summary per kind and the first max extents, then how many more
+     * there are
+     */
+    void print(size_t max) const;
+
+    /* numbers of the blocks of unit bytes touching any extent, one per
+     * line, like badblocks -o, returns false on error
+     */
+    bool write_list(const char *path, size_t unit) const;
+private:
+    Extents(Extents &&) = delete;
+    Extents & operator =(Extents &&) = delete;
+
+    mutable std::mutex mutex_;
+    // start -> end for each kind
+    std::map<off_t, off_t> map_[KINDS];
+};
+
+#endif // #ifndef EXTENTS_H
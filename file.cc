@@ -23,6 +23,9 @@
 #include <fcntl.h>
 #include <cassert>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
 #include <unistd.h>
 
 File::File(const char * name) {
@@ -44,6 +47,13 @@ File::File(const char * name) {
     */
     size_ = lseek(fd_, 0, SEEK_END);
     assert(size_ > 0);
+    sector_size_ = 512;
+    struct stat st;
+    int sector;
+    if ((fstat(fd_, &st) == 0) && S_ISBLK(st.st_mode)
+	&& (ioctl(fd_, BLKSSZGET, &sector) == 0)) {
+	sector_size_ = sector;
+    }
 }
 
 File::~File() {
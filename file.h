@@ -29,10 +29,13 @@ public:
     ~File();
     int fd() const { return fd_; }
     off_t size() const { return size_; }
+    // logical block size of the device, 512 for files
+    size_t sector_size() const { return sector_size_; }
 private:
     File(File &&) = delete;
     File & operator =(File &&) = delete;
     off_t size_;
+    size_t sector_size_;
     int fd_;
 };
 
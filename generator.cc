@@ -0,0 +1,475 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* data patterns written to and expected from the device
+ */
+
+#include "generator.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cassert>
+#include "pattern.h"
+#include "crc32c.h"
+
+enum {
+    SECTOR_WORDS = SECTOR / sizeof(uint64_t),
+    CHUNK = 32,			// sectors keyed at a time, 16KiB
+};
+
+// first word of a sector that differs and how many do
+static void report_words(const uint64_t *p, const uint64_t *expect,
+			 size_t n, off_t offset) {
+    size_t first = 0;
+    size_t num = 0;
+    for (size_t i = 0; i < n; ++i) {
+	if ((p[i] != expect[i]) && (num++ == 0)) first = i;
+    }
+    if (num == 0) return;
+    fprintf(stderr, "Read error in block at %#lx: expected %#lx, got %#lx"
+	    " (%zu of %zu words differ)\n", offset + first * sizeof(uint64_t),
+	    expect[first], p[first], num, n);
+}
+
+/* Offsets can't tell old data from new, but a sector that is a valid
+ * offset pattern for another place is misdirected.
+ */
+class OffsetGenerator : public Generator {
+public:
+    OffsetGenerator(uint64_t seed) : Generator(seed) { }
+
+    void fill(void *buf, size_t size, off_t offset) {
+	pattern_kernel().fill(buf, size, offset);
+    }
+
+    void check(const void *buf, size_t size, off_t offset) {
+	const PatternKernel &kernel = pattern_kernel();
+	const uint64_t *p = (const uint64_t *)buf;
+	size_t n = size / sizeof(uint64_t);
+	size_t i = 0;
+	while ((i += kernel.check(p + i, (n - i) * sizeof(uint64_t),
+				  offset + i * sizeof(uint64_t))) < n) {
+	    // classify the sector, continue after it
+	    size_t start = i / SECTOR_WORDS * SECTOR_WORDS;
+	    size_t end = std::min(start + SECTOR_WORDS, n);
+	    size_t len = (end - start) * sizeof(uint64_t);
+	    off_t o = offset + start * sizeof(uint64_t);
+	    off_t other = p[start];
+	    bool verbose = details();
+	    if ((other != o) && (other % SECTOR == o % SECTOR)
+		&& (kernel.check(p + start, len, other) == end - start)) {
+		if (verbose) {
+		    fprintf(stderr, "Read error in block at %#lx: "
+			    "misdirected sector (written for %#lx)\n",
+			    o, other);
+		}
+		bad(Extents::MISDIRECTED, o, len);
+	    } else {
+		if (verbose) {
+		    uint64_t expect[SECTOR_WORDS];
+		    kernel.fill(expect, len, o);
+		    report_words(p + start, expect, end - start, o);
+		}
+		bad(Extents::CORRUPT, o, len);
+	    }
+	    i = end;
+	}
+    }
+};
+
+// sectors of random data keyed by seed and offset
+class RandomGenerator : public Generator {
+public:
+    RandomGenerator(uint64_t seed) : Generator(seed) { }
+
+    void fill(void *buf, size_t size, off_t offset) {
+	size_t sectors = size / SECTOR;
+	for (size_t start = 0; start < sectors; start += CHUNK) {
+	    size_t num = std::min(sectors - start, size_t(CHUNK));
+	    uint64_t keys[CHUNK];
+	    make_keys(keys, num, offset + start * SECTOR);
+	    pattern_kernel().fill_random((char *)buf + start * SECTOR, num,
+					 keys);
+	}
+    }
+
+    void check(const void *buf, size_t size, off_t offset) {
+	size_t sectors = size / SECTOR;
+	for (size_t start = 0; start < sectors; start += CHUNK) {
+	    size_t num = std::min(sectors - start, size_t(CHUNK));
+	    check_chunk((const uint64_t *)buf + start * SECTOR_WORDS, num,
+			offset + start * SECTOR);
+	}
+    }
+private:
+    void check_chunk(const uint64_t *p, size_t sectors, off_t offset) {
+	const PatternKernel &kernel = pattern_kernel();
+	uint64_t keys[CHUNK];
+	make_keys(keys, sectors, offset);
+	size_t j = 0;
+	while (j < sectors) {
+	    j += kernel.check_random(p + j * SECTOR_WORDS, sectors - j,
+				     keys + j, 0) / SECTOR_WORDS;
+	    if (j >= sectors) break;
+	    if (details()) {
+		uint64_t expect[SECTOR_WORDS];
+		kernel.fill_random(expect, 1, keys + j);
+		report_words(p + j * SECTOR_WORDS, expect, SECTOR_WORDS,
+			     offset + j * SECTOR);
+	    }
+	    bad(Extents::CORRUPT, offset + j * SECTOR, SECTOR);
+	    ++j;
+	}
+    }
+
+    void make_keys(uint64_t *keys, size_t sectors, off_t offset) const {
+	for (size_t j = 0; j < sectors; ++j) {
+	    keys[j] = seed_ ^ (offset + j * SECTOR);
+	}
+    }
+};
+
+// one byte everywhere, a different one each pass
+class BadblocksGenerator : public Generator {
+public:
+    BadblocksGenerator(uint64_t seed) : Generator(seed) { }
+
+    void fill(void *buf, size_t size, off_t) {
+	memset(buf, byte(), size);
+    }
+
+    void check(const void *buf, size_t size, off_t offset) {
+	const uint64_t *p = (const uint64_t *)buf;
+	uint64_t word = byte() * 0x0101010101010101ULL;
+	// all words equal to the first one and that one right
+	if ((p[0] == word)
+	    && (memcmp(p, p + 1, size - sizeof(uint64_t)) == 0)) {
+	    return;
+	}
+	uint64_t expect[SECTOR_WORDS];
+	std::fill(expect, expect + SECTOR_WORDS, word);
+	size_t n = size / sizeof(uint64_t);
+	for (size_t start = 0; start < n; start += SECTOR_WORDS) {
+	    size_t len = std::min(size_t(SECTOR_WORDS), n - start);
+	    if (memcmp(p + start, expect, len * sizeof(uint64_t)) == 0) {
+		continue;
+	    }
+	    off_t o = offset + start * sizeof(uint64_t);
+	    if (details()) report_words(p + start, expect, len, o);
+	    bad(Extents::CORRUPT, o, len * sizeof(uint64_t));
+	}
+    }
+private:
+    int byte() const {
+	static const unsigned char PATTERNS[] = { 0xaa, 0x55, 0xff, 0x00 };
+	return PATTERNS[pass_ % sizeof(PATTERNS)];
+    }
+};
+
+/* Each sector starts with a header, the rest is random data keyed by
+ * the header so the sector can be verified on its own. All sectors of
+ * one write share the sequence number.
+ */
+class HeaderGenerator : public Generator {
+public:
+    HeaderGenerator(uint64_t seed) : Generator(seed), seq_(0) { }
+
+    void fill(void *buf, size_t size, off_t offset) {
+	uint64_t seq = seq_.fetch_add(1, std::memory_order_relaxed);
+	size_t sectors = size / SECTOR;
+	for (size_t start = 0; start < sectors; start += CHUNK) {
+	    uint64_t *p = (uint64_t *)buf + start * SECTOR_WORDS;
+	    off_t o = offset + start * SECTOR;
+	    size_t num = std::min(sectors - start, size_t(CHUNK));
+	    uint64_t keys[CHUNK];
+	    for (size_t j = 0; j < num; ++j) {
+		keys[j] = key(seed_, pass_, seq, o + j * SECTOR);
+	    }
+	    pattern_kernel().fill_random(p, num, keys);
+	    for (size_t j = 0; j < num; ++j) {
+		uint64_t *h = p + j * SECTOR_WORDS;
+		h[H_MAGIC] = MAGIC;
+		h[H_RUN] = seed_;
+		h[H_PASS] = pass_;
+		h[H_SEQ] = seq;
+		h[H_OFFSET] = o + j * SECTOR;
+	    }
+	}
+    }
+
+    void check(const void *buf, size_t size, off_t offset) {
+	const PatternKernel &kernel = pattern_kernel();
+	const uint64_t *p = (const uint64_t *)buf;
+	size_t sectors = size / SECTOR;
+	size_t current = 0;
+	size_t old = 0;
+	bool mixed = false;
+	uint64_t seq = 0;
+	for (size_t start = 0; start < sectors; start += CHUNK) {
+	    const uint64_t *q = p + start * SECTOR_WORDS;
+	    size_t num = std::min(sectors - start, size_t(CHUNK));
+
+	    // payload as the header says it should be
+	    uint64_t keys[CHUNK];
+	    bool broken[CHUNK];
+	    for (size_t j = 0; j < num; ++j) {
+		const uint64_t *h = q + j * SECTOR_WORDS;
+		keys[j] = key(h[H_RUN], h[H_PASS], h[H_SEQ], h[H_OFFSET]);
+		broken[j] = false;
+	    }
+	    size_t j = 0;
+	    while (j < num) {
+		j += kernel.check_random(q + j * SECTOR_WORDS, num - j,
+					 keys + j, HEADER_WORDS)
+		    / SECTOR_WORDS;
+		if (j < num) broken[j++] = true;
+	    }
+
+	    // then whether the header is the one we wrote
+	    for (j = 0; j < num; ++j) {
+		const uint64_t *h = q + j * SECTOR_WORDS;
+		off_t o = offset + (start + j) * SECTOR;
+		if (broken[j] || (h[H_MAGIC] != MAGIC)) {
+		    if (details()) {
+			fprintf(stderr, "Read error in block at %#lx: "
+				"corrupt sector\n", o);
+		    }
+		    bad(Extents::CORRUPT, o, SECTOR);
+		} else if ((h[H_RUN] != seed_) || (h[H_PASS] != pass_)) {
+		    if (details()) {
+			fprintf(stderr, "Read error in block at %#lx: "
+				"stale sector (run %#lx pass %lu)\n",
+				o, h[H_RUN], h[H_PASS]);
+		    }
+		    bad(Extents::STALE, o, SECTOR);
+		    ++old;
+		} else if (h[H_OFFSET] != uint64_t(o)) {
+		    if (details()) {
+			fprintf(stderr, "Read error in block at %#lx: "
+				"misdirected sector (written for %#lx)\n",
+				o, h[H_OFFSET]);
+		    }
+		    bad(Extents::MISDIRECTED, o, SECTOR);
+		} else {
+		    if ((current > 0) && (h[H_SEQ] != seq)) mixed = true;
+		    seq = h[H_SEQ];
+		    ++current;
+		}
+	    }
+	}
+	if ((current > 0) && (mixed || (old > 0))) {
+	    if (details()) {
+		fprintf(stderr, "Read error in block at %#lx: torn write\n",
+			offset);
+	    }
+	    bad(Extents::TORN, offset, size);
+	}
+    }
+private:
+    enum {
+	H_MAGIC,
+	H_RUN,
+	H_PASS,
+	H_SEQ,
+	H_OFFSET,
+	HEADER_WORDS,
+    };
+
+    static const uint64_t MAGIC = 0x31747365746e6564ULL; // "devtest1"
+
+    static uint64_t key(uint64_t run, uint64_t pass, uint64_t seq,
+			uint64_t offset) {
+	return mix64(mix64(mix64(run) ^ pass) ^ seq) ^ offset;
+    }
+
+    std::atomic<uint64_t> seq_;
+};
+
+/* Random data with a trailer per sector holding the offset, a tag for
+ * run and pass and a crc32c over the rest. Checking only needs the crc,
+ * the data is only regenerated to report what is wrong with a sector.
+ */
+class CRCGenerator : public Generator {
+public:
+    CRCGenerator(uint64_t seed) : Generator(seed) { }
+
+    void fill(void *buf, size_t size, off_t offset) {
+	uint32_t tag = this->tag();
+	size_t sectors = size / SECTOR;
+	// in chunks so the crc finds the data still in cache
+	for (size_t start = 0; start < sectors; start += CHUNK) {
+	    char *p = (char *)buf + start * SECTOR;
+	    off_t o = offset + start * SECTOR;
+	    size_t num = std::min(sectors - start, size_t(CHUNK));
+	    uint64_t keys[CHUNK];
+	    for (size_t j = 0; j < num; ++j) keys[j] = key(tag, o + j * SECTOR);
+	    pattern_kernel().fill_random(p, num, keys);
+	    for (size_t j = 0; j < num; ++j) {
+		Trailer *t = trailer(p, j);
+		t->offset = o + j * SECTOR;
+		t->tag = tag;
+	    }
+	    uint32_t crc[CHUNK];
+	    crc32c_blocks(p, num, SECTOR, CRC_LEN, crc);
+	    for (size_t j = 0; j < num; ++j) trailer(p, j)->crc = crc[j];
+	}
+    }
+
+    void check(const void *buf, size_t size, off_t offset) {
+	char *p = (char *)buf;
+	size_t sectors = size / SECTOR;
+	uint32_t tag = this->tag();
+	size_t current = 0;
+	size_t old = 0;
+	for (size_t start = 0; start < sectors; start += CHUNK) {
+	    char *q = p + start * SECTOR;
+	    size_t num = std::min(sectors - start, size_t(CHUNK));
+	    uint32_t crc[CHUNK];
+	    crc32c_blocks(q, num, SECTOR, CRC_LEN, crc);
+	    for (size_t j = 0; j < num; ++j) {
+		const Trailer *t = trailer(q, j);
+		off_t o = offset + (start + j) * SECTOR;
+		if (crc[j] != t->crc) {
+		    if (details()) {
+			fprintf(stderr, "Read error in block at %#lx: "
+				"corrupt sector (crc %#x, expected %#x)\n",
+				o, crc[j], t->crc);
+			uint64_t expect[SECTOR_WORDS];
+			uint64_t k = key(tag, o);
+			pattern_kernel().fill_random(expect, 1, &k);
+			report_words((const uint64_t *)(q + j * SECTOR),
+				     expect, PAYLOAD_WORDS, o);
+		    }
+		    bad(Extents::CORRUPT, o, SECTOR);
+		} else if (t->tag != tag) {
+		    if (details()) {
+			fprintf(stderr, "Read error in block at %#lx: "
+				"stale sector (tag %#x)\n", o, t->tag);
+		    }
+		    bad(Extents::STALE, o, SECTOR);
+		    ++old;
+		} else if (t->offset != uint64_t(o)) {
+		    if (details()) {
+			fprintf(stderr, "Read error in block at %#lx: "
+				"misdirected sector (written for %#lx)\n",
+				o, t->offset);
+		    }
+		    bad(Extents::MISDIRECTED, o, SECTOR);
+		} else {
+		    ++current;
+		}
+	    }
+	}
+	if ((current > 0) && (old > 0)) {
+	    if (details()) {
+		fprintf(stderr, "Read error in block at %#lx: torn write\n",
+			offset);
+	    }
+	    bad(Extents::TORN, offset, size);
+	}
+    }
+private:
+    struct Trailer {
+	uint64_t offset;
+	uint32_t tag;
+	uint32_t crc;
+    };
+
+    enum {
+	PAYLOAD_WORDS = (SECTOR - sizeof(Trailer)) / sizeof(uint64_t),
+	CRC_LEN = SECTOR - sizeof(uint32_t),
+    };
+
+    static Trailer * trailer(char *p, size_t sector) {
+	return (Trailer *)(p + (sector + 1) * SECTOR - sizeof(Trailer));
+    }
+
+    // run and pass in one word
+    uint32_t tag() const {
+	return mix64(seed_ ^ mix64(pass_ + 1));
+    }
+
+    uint64_t key(uint32_t tag, off_t offset) const {
+	return mix64(seed_ + tag) ^ offset;
+    }
+};
+
+Generator * Generator::create(Kind kind, uint64_t seed) {
+    switch (kind) {
+    case OFFSET: return new OffsetGenerator(seed);
+    case RANDOM: return new RandomGenerator(seed);
+    case BADBLOCKS: return new BadblocksGenerator(seed);
+    case HEADER: return new HeaderGenerator(seed);
+    case CRC: return new CRCGenerator(seed);
+    }
+    assert(false);
+    return nullptr;
+}
+
+const char * Generator::name(Kind kind) {
+    switch (kind) {
+    case OFFSET: return "offset";
+    case RANDOM: return "random";
+    case BADBLOCKS: return "badblocks";
+    case HEADER: return "header";
+    case CRC: return "crc";
+    }
+    assert(false);
+    return nullptr;
+}
+
+size_t Generator::align(Kind kind) {
+    return (kind == OFFSET) ? sizeof(off_t) : SECTOR;
+}
+
+Generator::~Generator() { }
+
+void Generator::bad(Extents::Kind kind, off_t offset, size_t size) {
+    switch (kind) {
+    case Extents::CORRUPT:
+	corrupt_.fetch_add(1, std::memory_order_relaxed);
+	break;
+    case Extents::MISDIRECTED:
+	misdirected_.fetch_add(1, std::memory_order_relaxed);
+	break;
+    case Extents::STALE:
+	stale_.fetch_add(1, std::memory_order_relaxed);
+	break;
+    case Extents::TORN:
+	torn_.fetch_add(1, std::memory_order_relaxed);
+	break;
+    default:
+	assert(false);
+    }
+    if (extents_ != nullptr) extents_->add(kind, offset, size);
+}
+
+bool Generator::details() {
+    uint64_t n = details_.fetch_add(1, std::memory_order_relaxed);
+    if (n == MAX_DETAILS) {
+	fprintf(stderr, "Further bad sectors are only recorded\n");
+    }
+    return n < MAX_DETAILS;
+}
+
+Generator::Errors Generator::errors() {
+    Errors errors;
+    errors.corrupt = corrupt_.exchange(0);
+    errors.misdirected = misdirected_.exchange(0);
+    errors.stale = stale_.exchange(0);
+    errors.torn = torn_.exchange(0);
+    return errors;
+}
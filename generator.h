@@ -0,0 +1,100 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* data patterns written to and expected from the device
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H 1
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+#include "extents.h"
+
+/* Fills blocks with a pattern and verifies them. Bad sectors are
+ * counted by what went wrong, as far as the pattern can tell, and
+ * added to the extents if set; only the first MAX_DETAILS are
+ * described on stderr:
+ *
+ * corrupt:     the data is garbage
+ * misdirected: the data belongs to another offset
+ * stale:       the data is from an older run or pass (lost write)
+ * torn:        a block mixes sectors from different writes
+ *
+ * fill() and check() may be called from many threads at once.
+ */
+class Generator {
+public:
+    enum Kind {
+	OFFSET,		// offset of each word, fast but not unique per run
+	RANDOM,		// xorshift keyed by seed and offset
+	BADBLOCKS,	// 0xaa, 0x55, 0xff, 0x00 like badblocks -w, by pass
+	HEADER,		// sector header with run, pass, sequence and offset
+	CRC,		// sector trailer with offset, run / pass and crc32c
+    };
+
+    struct Errors {
+	uint64_t corrupt;
+	uint64_t misdirected;
+	uint64_t stale;
+	uint64_t torn;
+    };
+
+    // seed doubles as run id
+    static Generator * create(Kind kind, uint64_t seed);
+    static const char * name(Kind kind);
+    // granularity blocks must have, in bytes
+    static size_t align(Kind kind);
+    virtual ~Generator();
+
+    uint64_t seed() const { return seed_; }
+    // where bad sectors go, nullptr only counts them
+    void extents(Extents *extents) { extents_ = extents; }
+    // pass number written from now on and expected by check()
+    void pass(uint64_t pass) { pass_ = pass; }
+
+    virtual void fill(void *buf, size_t size, off_t offset) = 0;
+    virtual void check(const void *buf, size_t size, off_t offset) = 0;
+
+    // errors counted since the last call
+    Errors errors();
+protected:
+    enum { MAX_DETAILS = 16 };
+
+    Generator(uint64_t seed)
+	: seed_(seed), pass_(0), extents_(nullptr), details_(0),
+	  corrupt_(0), misdirected_(0), stale_(0), torn_(0) { }
+
+    // count a bad sector (a block if TORN) and record it
+    void bad(Extents::Kind kind, off_t offset, size_t size);
+    // whether to describe the next bad sector on stderr
+    bool details();
+
+    uint64_t seed_;
+    uint64_t pass_;
+    Extents *extents_;
+    std::atomic<uint64_t> details_;
+    std::atomic<uint64_t> corrupt_;
+    std::atomic<uint64_t> misdirected_;
+    std::atomic<uint64_t> stale_;
+    std::atomic<uint64_t> torn_;
+private:
+    Generator(Generator &&) = delete;
+    Generator & operator =(Generator &&) = delete;
+};
+
+#endif // #ifndef GENERATOR_H
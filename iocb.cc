@@ -21,12 +21,8 @@
 #include "iocb.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <cstdint>
 #include "file.h"
-
-enum {
-    BLOCK_ALIGN = 4096,
-};
+#include "generator.h"
 
 static constexpr const char * STATE[] = {
     "BLANK",
@@ -37,14 +33,11 @@ static constexpr const char * STATE[] = {
     "MOVED",
 };
 
-IOCB::IOCB(File &file, Kind kind, size_t size)
-    : buf_(aligned_alloc(BLOCK_ALIGN, size)), state_(BLANK) {
+IOCB::IOCB(File &file, Kind kind, Generator *gen, void *buf, size_t size)
+    : gen_(gen), buf_(buf), buf_index_(-1), lane_(0), block_(0), start_(0),
+      end_(0), due_(0), res_(0), state_(BLANK), older_(nullptr),
+      newer_(nullptr) {
     assert(size % sizeof(off_t) == 0);
-    if (buf_ == nullptr) {
-	fprintf(stderr, "%s: aligned_alloc() failed\n",
-		__PRETTY_FUNCTION__);
-	exit(1);
-    }
     if (kind == READ) {
 	io_prep_pread(&iocb_, file.fd(), buf_, size, 0);
     } else {
@@ -59,7 +52,6 @@ IOCB::~IOCB() {
 		__PRETTY_FUNCTION__, STATE[state_]);
 	assert(false);
     }
-    free(buf_);
     state_ = DEAD;
     buf_ = nullptr;
     memset(&iocb_, 0xEE, sizeof(iocb_));
@@ -67,15 +59,8 @@ IOCB::~IOCB() {
 
 void IOCB::fill() {
     assert(state_ == PREPPED);
-    off_t o = iocb_.u.c.offset;
-    if (iocb_.aio_lio_opcode == IO_CMD_PWRITE) {
-	off_t *p = (off_t *)buf_;
-	off_t *q = (off_t *)(uintptr_t(buf_) + iocb_.u.c.nbytes);
-	while (p < q) {
-	    *p = o;
-	    ++p;
-	    o += sizeof(off_t);
-	}
+    if ((iocb_.aio_lio_opcode == IO_CMD_PWRITE) && (gen_ != nullptr)) {
+	gen_->fill(buf_, iocb_.u.c.nbytes, iocb_.u.c.offset);
     }
     state_ = FILLED;
 }
@@ -83,18 +68,9 @@ void IOCB::fill() {
 void IOCB::check() {
     if (iocb_.aio_lio_opcode == IO_CMD_PREAD) {
 	assert(state_ == SUBMITTED);
-	off_t *p = (off_t *)buf_;
-	off_t *q = (off_t *)(uintptr_t(buf_) + iocb_.u.c.nbytes);
-	off_t o = iocb_.u.c.offset;
-	while (p < q) {
-	    if (*p != o) {
-		fprintf(stderr,
-			"Read error in block at %#llx: expected %#lx, got %#lx\n",
-			iocb_.u.c.offset + uintptr_t(p) - uintptr_t(buf_),
-			o, *p);
-	    }
-	    ++p;
-	    o += sizeof(off_t);
+	// failed requests were checked where they transferred on retry
+	if ((gen_ != nullptr) && (res_ == long(iocb_.u.c.nbytes))) {
+	    gen_->check(buf_, iocb_.u.c.nbytes, iocb_.u.c.offset);
 	}
     } else {
 	assert((state_ == SUBMITTED) || (state_ == BLANK));
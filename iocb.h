@@ -23,8 +23,10 @@
 
 #include <libaio.h>
 #include <cassert>
+#include <cstdint>
 
 class File;
+class Generator;
 
 class IOCB {
 public:
@@ -42,7 +44,10 @@ public:
 	MOVED,
     };
 
-    IOCB(File &file, Kind kind, size_t size);
+    /* size bytes at buf, owned by the caller (usually an Arena slice),
+     * filled and checked by gen unless it is nullptr
+     */
+    IOCB(File &file, Kind kind, Generator *gen, void *buf, size_t size);
     ~IOCB();
 
     void offset(off_t o) {
@@ -59,12 +64,118 @@ public:
 	return iocb_.u.c.nbytes;
     }
 
+    Kind kind() const {
+	return (iocb_.aio_lio_opcode == IO_CMD_PREAD) ? READ : WRITE;
+    }
+
+    // change direction between uses
+    void kind(Kind kind) {
+	assert(state_ == BLANK);
+	iocb_.aio_lio_opcode = (kind == READ) ? IO_CMD_PREAD : IO_CMD_PWRITE;
+    }
+
+    // change pattern between uses, nullptr moves the data as is
+    void gen(Generator *gen) {
+	assert(state_ == BLANK);
+	gen_ = gen;
+    }
+
+    Generator * gen() const {
+	return gen_;
+    }
+
+    State state() const {
+	return state_;
+    }
+
+    void * buf() const {
+	return buf_;
+    }
+
+    // index of the registered buffer containing buf(), -1 if none
+    int buf_index() const {
+	return buf_index_;
+    }
+
+    void buf_index(int index) {
+	buf_index_ = index;
+    }
+
+    // which IOThread the IOCB belongs to
+    int lane() const {
+	return lane_;
+    }
+
+    void lane(int l) {
+	lane_ = l;
+    }
+
+    // index of the block within the lane's shard
+    uint64_t block() const {
+	return block_;
+    }
+
+    void block(uint64_t b) {
+	block_ = b;
+    }
+
+    // time from submit to reap, set by whoever drives the backend
+    void started(uint64_t ns) {
+	start_ = ns;
+    }
+
+    uint64_t started() const {
+	return start_;
+    }
+
+    void finished(uint64_t ns) {
+	end_ = ns;
+    }
+
+    uint64_t finished() const {
+	return end_;
+    }
+
+    uint64_t latency() const {
+	return end_ - start_;
+    }
+
+    // when an open loop load wanted it submitted
+    void due(uint64_t ns) {
+	due_ = ns;
+    }
+
+    uint64_t due() const {
+	return due_;
+    }
+
+    // time from due to reap, queueing in front of the device included
+    uint64_t response() const {
+	return end_ - due_;
+    }
+
+    // bytes transfered or -errno as reported by the backend
+    long result() const {
+	return res_;
+    }
+
+    void result(long res) {
+	assert(state_ == SUBMITTED);
+	res_ = res;
+    }
+
     struct iocb * iocb(void) {
 	assert(state_ == FILLED);
 	state_ = SUBMITTED;
 	return &iocb_;
     }
 
+    // the struct iocb of a request in flight, e.g. to cancel it
+    struct iocb * submitted(void) {
+	assert(state_ == SUBMITTED);
+	return &iocb_;
+    }
+
     static IOCB * iocb(struct iocb *obj) {
 	IOCB * res = (IOCB *)obj->data;
 	return res;
@@ -78,8 +189,21 @@ private:
     IOCB & operator =(IOCB &&) = delete;
 
     struct iocb iocb_;
+    Generator *gen_;
     void *buf_;
+    int buf_index_;
+    int lane_;
+    uint64_t block_;
+    uint64_t start_;
+    uint64_t end_;
+    uint64_t due_;
+    long res_;
     State state_;
+    // neighbours while in flight, owned by InFlight
+    IOCB *older_;
+    IOCB *newer_;
+
+    friend class InFlight;
 };
 
 #endif // #ifndef IOCB_H
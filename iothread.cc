@@ -15,83 +15,132 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 */
 
-/* iothread using libaio
+/* iothread driving an IO backend
  */
 
 #include "iothread.h"
 #include <sys/select.h>
+#include <stdio.h>
+#include <errno.h>
 #include "eventfd.h"
 #include <algorithm>
+#include "clock.h"
 
 // #include <libaio.h>
 // #include <stdio.h>
 // #include <sys/eventfd.h>
 // #include <stdint.h>
 
-IOThread::IOThread(int max_events, ReadPipe<IOCB> in, WritePipe<IOCB> out)
-    : ctx_(max_events), in_(std::move(in)), out_(std::move(out)),
-      thread_(&IOThread::run, this) { }
+IOThread::IOThread(Backend *backend, int batch, int spin,
+		   Watchdog &watchdog, ReadRing<IOCB> in, WriteRing<IOCB> out,
+		   WriteRing<IOCB> failed)
+    : backend_(backend), batch_(std::min(batch, backend->max_events())),
+      spin_(spin), stats_(), inflight_(watchdog, backend),
+      in_(std::move(in)), out_(std::move(out)), failed_(std::move(failed)),
+      thread_(&IOThread::run, this) {
+    assert(batch_ > 0);
+}
 
 IOThread::~IOThread() {
     thread_.join();
+    delete backend_;
 }
 
 void IOThread::run(void) {
     EventFD e;
-    int efd = e.fd();
-    int infd = in_.fd();
-    int nfds = std::max(efd, infd) + 1;
+    backend_->set_eventfd(e.fd());
+    int max_events = backend_->max_events();
     int pending = 0;
+    IOCB * iocbs[max_events];
 
     while (in_ || (pending > 0)) {
-	// keep submitting IOCBs till max_events
+	// keep submitting IOCBs till max_events, batch_ at a time
 	// break if events are pending and nothing to submitt
-	while (in_ && (pending < ctx_.max_events())) {
-	    fd_set set;
-	    FD_ZERO(&set);
-	    FD_SET(efd, &set);
-	    FD_SET(infd, &set);
-	    int res = select(nfds, &set, nullptr, nullptr, nullptr);
-	    if (res == -1) {
-		if (errno == EINTR) continue;
-		perror(__PRETTY_FUNCTION__);
-		assert(false);
+	while (in_ && (pending < max_events)) {
+	    // only block on the ring when nothing is pending
+	    int free = std::min(max_events - pending, batch_);
+	    size_t num = (pending == 0)
+		? in_.read_batch(iocbs, free)
+		: in_.try_read_batch(iocbs, free);
+	    if (num == 0) break;
+	    uint64_t now = now_ns();
+	    for (size_t i = 0; i < num; ++i) {
+		iocbs[i]->started(now);
+		inflight_.add(iocbs[i]);
 	    }
-	    assert(res > 0);
+	    backend_->submit(num, iocbs);
+	    pending += num;
+	    ++stats_.submit_calls;
+	    stats_.submitted += num;
+	}
+	if (pending == 0) continue;
 
-	    if (FD_ISSET(infd, &set)) {
-		IOCB * iocb = in_.read();
-		if (iocb == nullptr) {
-		    assert(!in_);
-		    break;
-		}
-		struct iocb *p = iocb->iocb();
-		io_set_eventfd(p, efd);
-		ctx_.submit(1, &p);
-		++pending;
-	    } else {
-		// nothing to submit but events pending
-		break;
-	    }
+	/* block for completions if there is nothing else to wait for,
+	 * spin a while before paying for a sleep and wakeup, input that
+	 * comes meanwhile waits at most that long
+	 */
+	int min_nr = (!in_ || (pending == max_events)) ? 1 : 0;
+	uint64_t timeout = (min_nr > 0) ? inflight_.check(now_ns()) : 0;
+	int res = backend_->reap(min_nr, pending, iocbs, timeout, spin_,
+				 stats_.sleeps);
+	if (res == 0) {
+	    // polled or woken up to look for stuck requests
+	    if (backend_->polled() || (min_nr > 0)) continue;
+	    ++stats_.sleeps;
+	    wait(e, inflight_.check(now_ns()));
+	    continue;
 	}
-	if (pending > 0) {
-	    uint64_t num_events = e.read();
-	    struct io_event event[num_events];
-	    int res = ctx_.getevents(num_events, num_events, event);
-	    assert(res >= 0);
-	    assert(uint64_t(res) == num_events);
-	    pending -= res;
-	    for (int i = 0; i < res; ++i) {
-		IOCB * iocb = (IOCB *)event[i].obj->data;
-		if ((event->res != iocb->size()) || (event->res2 != 0)) {
-		    fprintf(stderr, "res = %lx, res2 = %ld at offset %lx\n",
-			    event->res, event->res2, iocb->offset());
-		    assert(false);
-		}
-		out_.write(iocb);
+	pending -= res;
+	++stats_.reap_calls;
+	stats_.reaped += res;
+	uint64_t now = now_ns();
+	int good = 0;
+	for (int i = 0; i < res; ++i) {
+	    IOCB * iocb = iocbs[i];
+	    iocb->finished(now);
+	    inflight_.remove(iocb);
+	    if (iocb->result() != long(iocb->size())) {
+		failed_.write(iocb);
+	    } else {
+		iocbs[good++] = iocb;
 	    }
 	}
+	out_.write_batch(iocbs, good);
+	// a busy thread never sleeps, look at the stuck ones here too
+	inflight_.check(now);
     }
     out_.close();
+    failed_.close();
 }
 
+// wait for input or completions, at most timeout ns unless it is 0
+void IOThread::wait(EventFD & e, uint64_t timeout) {
+    assert(in_);
+    if (!in_.sleep_begin()) return;
+    int efd = e.fd();
+    int infd = in_.fd();
+    int nfds = std::max(efd, infd) + 1;
+    fd_set set;
+    // rounded up, waking early would only find nothing to do
+    uint64_t us = (timeout + 999) / 1000;
+    while (true) {
+	FD_ZERO(&set);
+	FD_SET(efd, &set);
+	FD_SET(infd, &set);
+	struct timeval limit = { time_t(us / 1000000), long(us % 1000000) };
+	int res = select(nfds, &set, nullptr, nullptr,
+			 (timeout == 0) ? nullptr : &limit);
+	if (res == -1) {
+	    if (errno != EINTR) {
+		perror(__PRETTY_FUNCTION__);
+		assert(false);
+	    }
+	    if (timeout == 0) continue;
+	    // the caller looks again with what is left of the timeout
+	    FD_ZERO(&set);
+	}
+	break;
+    }
+    in_.sleep_end(FD_ISSET(infd, &set));
+    if (FD_ISSET(efd, &set)) e.read();
+}
@@ -15,29 +15,58 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 */
 
-/* iothread using libaio
+/* iothread driving an IO backend
  */
 
 #ifndef IOTHREAD_H
 #define IOTHREAD_H 1
 
 #include <thread>
-#include "context.h"
+#include <cstdint>
+#include "backend.h"
+#include "eventfd.h"
 #include "iocb.h"
-#include "pipe.h"
+#include "ring.h"
+#include "watchdog.h"
 
 class IOThread {
 public:
-    IOThread(int max_events, ReadPipe<IOCB> in, WritePipe<IOCB> out);
+    struct Stats {
+	uint64_t submit_calls;
+	uint64_t submitted;
+	uint64_t reap_calls; // that found something
+	uint64_t reaped;
+	uint64_t sleeps;
+    };
+
+    /* takes ownership of backend, spins up to spin us for input or
+     * completions before sleeping, requests that fail or come back
+     * short go to failed instead of out, requests in flight are
+     * watched by watchdog
+     */
+    IOThread(Backend *backend, int batch, int spin, Watchdog &watchdog,
+	     ReadRing<IOCB> in, WriteRing<IOCB> out,
+	     WriteRing<IOCB> failed);
     ~IOThread();
+    /* only valid once the output ring has seen EOF or while all IOCBs
+     * are out of the iothread
+     */
+    const Stats & stats() const { return stats_; }
+    std::thread & thread() { return thread_; }
 private:
     IOThread(IOThread &&) = delete;
     IOThread & operator =(IOThread &&) = delete;
     void run(void);
+    void wait(EventFD & e, uint64_t timeout);
 
-    Context ctx_;    
-    ReadPipe<IOCB> in_;
-    WritePipe<IOCB> out_;
+    Backend *backend_;
+    int batch_;
+    int spin_;
+    Stats stats_;
+    InFlight inflight_;
+    ReadRing<IOCB> in_;
+    WriteRing<IOCB> out_;
+    WriteRing<IOCB> failed_;
     std::thread thread_;
 };
 
@@ -0,0 +1,231 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* backup of blocks under test for non-destructive runs
+ */
+
+#include "journal.h"
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <cassert>
+#include <string>
+#include "file.h"
+#include "crc32c.h"
+
+static const uint64_t MAGIC = 0x6a74736574766564ULL; // "devtestj"
+static const uint64_t SAVED = 0x6465766173766564ULL; // "devsaved"
+
+struct Head {
+    uint64_t magic;
+    uint64_t blocksize;
+    uint64_t slots;
+    uint64_t pad;
+};
+
+// in front of the data of each slot
+struct Entry {
+    uint64_t magic;
+    uint64_t offset;
+    uint64_t crc;
+    uint64_t pad;
+};
+
+static off_t position(size_t slot, size_t blocksize) {
+    return sizeof(Head) + slot * (sizeof(Entry) + blocksize);
+}
+
+static bool read_all(int fd, void *buf, size_t size, off_t offset) {
+    return pread(fd, buf, size, offset) == ssize_t(size);
+}
+
+static void write_all(int fd, const void *buf, size_t size, off_t offset) {
+    ssize_t res = pwrite(fd, buf, size, offset);
+    if (res != ssize_t(size)) {
+	fprintf(stderr, "%s: pwrite(): %s\n", __PRETTY_FUNCTION__,
+		(res < 0) ? strerror(errno) : "short write");
+	exit(1);
+    }
+}
+
+static void sync_fd(int fd) {
+    if (fdatasync(fd) != 0) {
+	fprintf(stderr, "%s: fdatasync(): %s\n", __PRETTY_FUNCTION__,
+		strerror(errno));
+	exit(1);
+    }
+}
+
+// make a new directory entry for path durable
+static void sync_dir(const char *path) {
+    std::string dir(path);
+    size_t slash = dir.rfind('/');
+    dir = (slash == std::string::npos) ? "." : dir.substr(0, slash + 1);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return;
+    fsync(fd);
+    close(fd);
+}
+
+// number of saved blocks, -1 if fd holds no journal
+static long count(int fd) {
+    Head head;
+    if (!read_all(fd, &head, sizeof(head), 0) || (head.magic != MAGIC)) {
+	return -1;
+    }
+    long num = 0;
+    for (size_t slot = 0; slot < head.slots; ++slot) {
+	Entry entry;
+	if (!read_all(fd, &entry, sizeof(entry),
+		      position(slot, head.blocksize))) {
+	    break;
+	}
+	if (entry.magic == SAVED) ++num;
+    }
+    return num;
+}
+
+Journal::Journal(const char *path, size_t blocksize, size_t slots)
+    : fd_(-1), blocksize_(blocksize), slots_(slots), dirty_(false) {
+    fd_ = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd_ == -1) {
+	fprintf(stderr, "Error: can't open journal %s: %s\n", path,
+		strerror(errno));
+	exit(1);
+    }
+    long saved = count(fd_);
+    if (saved > 0) {
+	fprintf(stderr, "Error: journal %s holds %ld blocks of an"
+		" interrupted run, put them back with --restore first\n",
+		path, saved);
+	exit(1);
+    }
+    if (ftruncate(fd_, 0) != 0) {
+	fprintf(stderr, "%s: ftruncate(): %s\n", __PRETTY_FUNCTION__,
+		strerror(errno));
+	exit(1);
+    }
+    Head head = { MAGIC, blocksize_, slots_, 0 };
+    write_all(fd_, &head, sizeof(head), 0);
+    sync_fd(fd_);
+    sync_dir(path);
+}
+
+Journal::~Journal() {
+    sync();
+    int res = close(fd_);
+    if (res != 0) {
+	perror("~Journal(): close()");
+	assert(false);
+    }
+}
+
+void Journal::save(size_t slot, off_t offset, const void *buf) {
+    assert(slot < slots_);
+    Entry entry = { SAVED, uint64_t(offset), crc32c(buf, blocksize_), 0 };
+    struct iovec iov[2] = {
+	{ &entry, sizeof(entry) },
+	{ const_cast<void *>(buf), blocksize_ },
+    };
+    ssize_t size = sizeof(entry) + blocksize_;
+    ssize_t res = pwritev(fd_, iov, 2, position(slot, blocksize_));
+    if (res != size) {
+	fprintf(stderr, "%s: pwritev(): %s\n", __PRETTY_FUNCTION__,
+		(res < 0) ? strerror(errno) : "short write");
+	exit(1);
+    }
+    dirty_ = true;
+}
+
+void Journal::clear(size_t slot) {
+    assert(slot < slots_);
+    Entry entry = { 0, 0, 0, 0 };
+    write_all(fd_, &entry, sizeof(entry), position(slot, blocksize_));
+    dirty_ = true;
+}
+
+void Journal::sync() {
+    if (!dirty_) return;
+    sync_fd(fd_);
+    dirty_ = false;
+}
+
+long Journal::restore(const char *path, File &file) {
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+	fprintf(stderr, "Error: can't open journal %s: %s\n", path,
+		strerror(errno));
+	return -1;
+    }
+    Head head;
+    if (!read_all(fd, &head, sizeof(head), 0)) {
+	// emptied by an earlier restore
+	close(fd);
+	return 0;
+    }
+    if (head.magic != MAGIC) {
+	fprintf(stderr, "Error: %s is not a journal\n", path);
+	close(fd);
+	return -1;
+    }
+    // the device is opened O_DIRECT
+    void *buf = nullptr;
+    if (posix_memalign(&buf, 4096, head.blocksize) != 0) {
+	fprintf(stderr, "%s: posix_memalign() failed\n", __PRETTY_FUNCTION__);
+	exit(1);
+    }
+    long num = 0;
+    for (size_t slot = 0; slot < head.slots; ++slot) {
+	off_t pos = position(slot, head.blocksize);
+	Entry entry;
+	if (!read_all(fd, &entry, sizeof(entry), pos)) break;
+	if (entry.magic != SAVED) continue;
+	/* a damaged slot never got synced, so the block was not
+	 * overwritten yet
+	 */
+	if (!read_all(fd, buf, head.blocksize, pos + sizeof(entry))
+	    || (crc32c(buf, head.blocksize) != entry.crc)) {
+	    fprintf(stderr, "Warning: slot %zu of %s is damaged, skipped\n",
+		    slot, path);
+	    continue;
+	}
+	ssize_t res = pwrite(file.fd(), buf, head.blocksize, entry.offset);
+	if (res != ssize_t(head.blocksize)) {
+	    fprintf(stderr, "Error: restoring block at %#lx: %s\n",
+		    entry.offset, (res < 0) ? strerror(errno) : "short write");
+	    free(buf);
+	    close(fd);
+	    return -1;
+	}
+	++num;
+    }
+    free(buf);
+    sync_fd(file.fd());
+    // everything is back, start the next run empty
+    if (ftruncate(fd, 0) != 0) {
+	fprintf(stderr, "%s: ftruncate(): %s\n", __PRETTY_FUNCTION__,
+		strerror(errno));
+	exit(1);
+    }
+    sync_fd(fd);
+    close(fd);
+    return num;
+}
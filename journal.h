@@ -0,0 +1,67 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* backup of blocks under test for non-destructive runs
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H 1
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+
+class File;
+
+/* File with one slot per block in flight. The original data of a block
+ * is saved to a slot and synced before the block gets overwritten and
+ * the slot is cleared once the data is back in place, so an
+ * interrupted run can be undone with restore(). Only used by one
+ * thread.
+ */
+class Journal {
+public:
+    /* creates the journal at path, exits if it still holds blocks of
+     * an earlier run
+     */
+    Journal(const char *path, size_t blocksize, size_t slots);
+    ~Journal();
+
+    size_t slots() const { return slots_; }
+
+    // remember the original data of the block at offset
+    void save(size_t slot, off_t offset, const void *buf);
+    // data of the slot is back on the device
+    void clear(size_t slot);
+    // make everything saved so far durable, no-op if nothing was
+    void sync();
+
+    /* write all blocks saved in the journal at path back to file and
+     * empty the journal, returns the number of blocks or -1 on error
+     */
+    static long restore(const char *path, File &file);
+private:
+    Journal(Journal &&) = delete;
+    Journal & operator =(Journal &&) = delete;
+
+    int fd_;
+    size_t blocksize_;
+    size_t slots_;
+    bool dirty_;
+};
+
+#endif // #ifndef JOURNAL_H
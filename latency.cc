@@ -0,0 +1,63 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* latency and throughput of one direction
+ */
+
+#include "latency.h"
+#include <stdio.h>
+#include <cmath>
+
+void Latency::print(const char *phase, const char *dir,
+		    double seconds) const {
+    printf("%s: %lu %ss, %.1f MiB/s, latency avg %.1f us, max %.1f us\n",
+	   phase, ops_, dir, bytes_ / 1024.0 / 1024.0 / seconds,
+	   sum_ / 1000.0 / std::max(ops_, uint64_t(1)), max_ / 1000.0);
+}
+
+void Histogram::add(const Histogram &other) {
+    for (int i = 0; i < BUCKETS; ++i) {
+	count_[i] += other.count_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+}
+
+uint64_t Histogram::percentile(double fraction) const {
+    uint64_t want = std::max(uint64_t(std::ceil(fraction * total_)),
+			     uint64_t(1));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+	seen += count_[i];
+	if (seen >= want) return std::min(top(i), max_);
+    }
+    return max_;
+}
+
+void Histogram::print(const char *phase, const char *what) const {
+    printf("%s: %s p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f,"
+	   " p99.99 %.1f, max %.1f us\n", phase, what,
+	   percentile(0.5) / 1000.0, percentile(0.9) / 1000.0,
+	   percentile(0.99) / 1000.0, percentile(0.999) / 1000.0,
+	   percentile(0.9999) / 1000.0, max_ / 1000.0);
+}
+
+uint64_t Histogram::top(unsigned bucket) {
+    if (bucket < SUB) return bucket;
+    unsigned shift = bucket / SUB - 1;
+    uint64_t low = uint64_t(bucket - shift * SUB) << shift;
+    return low + (uint64_t(1) << shift) - 1;
+}
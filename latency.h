@@ -0,0 +1,103 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* latency and throughput of one direction
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H 1
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+class Latency {
+public:
+    Latency() : ops_(0), bytes_(0), sum_(0), max_(0) { }
+
+    void add(uint64_t ns, size_t bytes) {
+	++ops_;
+	bytes_ += bytes;
+	sum_ += ns;
+	max_ = std::max(max_, ns);
+    }
+
+    void add(const Latency &other) {
+	ops_ += other.ops_;
+	bytes_ += other.bytes_;
+	sum_ += other.sum_;
+	max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t ops() const { return ops_; }
+    // in ns
+    uint64_t avg() const { return sum_ / std::max(ops_, uint64_t(1)); }
+    uint64_t max() const { return max_; }
+
+    // one line summary, seconds is how long it all took
+    void print(const char *phase, const char *dir, double seconds) const;
+private:
+    uint64_t ops_;
+    uint64_t bytes_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+/* Latencies in ns, log-linear like HdrHistogram: exact below SUB, then
+ * SUB buckets per power of two, so a percentile is off by less than
+ * 1 / SUB. add() is a few instructions without locks, keep one per
+ * thread and merge them at the end.
+ */
+class Histogram {
+public:
+    enum {
+	BITS = 5,
+	SUB = 1 << BITS,
+	BUCKETS = (65 - BITS) * SUB,
+    };
+
+    Histogram() : count_(), total_(0), max_(0) { }
+
+    void add(uint64_t ns) {
+	++count_[bucket(ns)];
+	++total_;
+	max_ = std::max(max_, ns);
+    }
+
+    void add(const Histogram &other);
+
+    uint64_t count() const { return total_; }
+    // latency fraction of all requests stay below, in ns
+    uint64_t percentile(double fraction) const;
+
+    // p50 to p99.99 and max in one line, what is e.g. "read latency"
+    void print(const char *phase, const char *what) const;
+private:
+    static unsigned bucket(uint64_t ns) {
+	if (ns < SUB) return ns;
+	unsigned shift = 63 - __builtin_clzll(ns) - BITS;
+	return shift * SUB + (ns >> shift);
+    }
+
+    // largest value in bucket
+    static uint64_t top(unsigned bucket);
+
+    uint64_t count_[BUCKETS];
+    uint64_t total_;
+    uint64_t max_;
+};
+
+#endif // #ifndef LATENCY_H
@@ -22,26 +22,165 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <sstream>
+#include <vector>
+#include <set>
+#include <deque>
+#include <string.h>
+#include <algorithm>
 #include <signal.h>
 #include <unistd.h>
 #include <sys/time.h>
-#include "pipe.h"
+#include "ring.h"
 #include "worker.h"
 #include "file.h"
 #include "iocb.h"
 #include "iothread.h"
+#include "backend.h"
+#include "shard.h"
+#include "corethread.h"
+#include "eventfd.h"
+#include "affinity.h"
+#include "arena.h"
+#include "pattern.h"
+#include "generator.h"
+#include "crc32c.h"
+#include "latency.h"
+#include "clock.h"
+#include "journal.h"
+#include "regions.h"
+#include "badblocks.h"
+#include "extents.h"
+#include "sweep.h"
+#include "watchdog.h"
+#include <random>
+#include <poll.h>
+#include <errno.h>
 
 void usage(const char *cmd) {
     printf("%s <options> <name>\n", cmd);
     printf("   --blocksize|-b <size>  Size of IO requests\n");
-    printf("   --requests|-r <num>    Number of parallel requests\n");
+    printf("   --requests|-r <num>    Number of parallel requests per iothread\n");
+    printf("   --batch|-B <num>       Max requests per io_submit (default: requests)\n");
+    printf("   --backend|-I <name>    IO backend: aio (default) or uring\n");
+    printf("   --sqpoll|-S            uring: kernel thread polls submissions\n");
+    printf("   --iopoll|-P            uring: busy poll for completions\n");
+    printf("   --poll|-p <usec>       Spin for completions before sleeping\n");
+    printf("   --engine|-e <name>     pipeline (default): fill/check in workers\n");
+    printf("                          percore: each iothread does everything\n");
+    printf("   --iothreads|-t <num>   Number of iothreads, each with its own slice\n");
+    printf("   --shard|-s <mode>      How to slice: stripe (default) or range\n");
+    printf("   --mix|-M <percent>     Write phase issues this many %% reads of\n");
+    printf("                          blocks already written\n");
+    printf("   --iops|-q <num>        Open loop: submit num requests per second on\n");
+    printf("                          a fixed timetable, latency counts from it\n");
+    printf("   --bandwidth|-Q <MiB/s> Same as --iops bandwidth / blocksize\n");
+    printf("   --verify-lag|-V <num>  Single pass: read back each block after num\n");
+    printf("                          more writes instead of a read phase\n");
+    printf("   --passes|-x <list>     pattern[:direction][:order],... or badblocks,\n");
+    printf("                          direction write, read, verify or preserve,\n");
+    printf("                          scan[:order] only reads (default: write, read)\n");
+    printf("   --regions|-G <num>     Scans report latency for num parts of the\n");
+    printf("                          device (default: 16)\n");
+    printf("   --slow|-f <factor>     Report parts of the device with a p50 or p99\n");
+    printf("                          latency factor times the device's (default: 3)\n");
+    printf("   --heatmap|-a <file>    Latency and throughput of every pass for up\n");
+    printf("                          to 4096 parts of the device as csv\n");
+    printf("   --nondestructive|-n    Only read and preserve passes, which save each\n");
+    printf("                          block, test it and write it back\n");
+    printf("   --journal|-j <file>    Backup of the blocks preserve passes have in\n");
+    printf("                          flight, synced before they are overwritten\n");
+    printf("   --restore|-u           Write the blocks in --journal back and exit\n");
+    printf("   --retries|-y <num>     Retries of each sector of a failed request\n");
+    printf("                          before it counts as bad (default: 2)\n");
+    printf("   --bad-list|-O <file>   Write the blocks found bad there, one number\n");
+    printf("                          per line like badblocks -o\n");
+    printf("   --stall|-C <ms>        Requests in flight longer are reported as\n");
+    printf("                          stuck (default: 10000, 0 for never)\n");
+    printf("   --stall-action|-A <action> report (default), cancel or abort\n");
+    printf("   --sweep|-X <spec>      Benchmark [read|write:]depth,...:size,...\n");
+    printf("                          instead of passes, reports the knee\n");
+    printf("   --sweep-size|-Z <size> Region the sweep uses (default: 1GiB)\n");
+    printf("   --warmup|-K <ms>       Sweep: time before a cell counts (default: 200)\n");
+    printf("   --window|-J <ms>       Sweep: time a cell is measured (default: 1000)\n");
+    printf("   --sweep-output|-F <file> Sweep results as csv, json if *.json\n");
+    printf("   --order|-o <order>     sequential (default) or random, each block\n");
+    printf("                          once in an order given by --seed, the\n");
+    printf("                          same for every pass\n");
     printf("   --memory|-m <size>     Amount of memory used for buffers\n");
+    printf("   --hugepages|-H <mode>  Buffer pages: small (default), thp or hugetlb\n");
+    printf("   --mlock|-L             Lock buffers in RAM\n");
+    printf("   --pattern|-D <name>    Data: offset (default), random, badblocks,\n");
+    printf("                          header or crc\n");
+    printf("   --seed|-R <num>        Seed / run id (default: random)\n");
     printf("   --workers|-w <num>     Number of worker threads\n");
+    printf("   --worker-cpus|-W <list>   Pin workers to cpus, e.g. 0-3,8 or node\n");
+    printf("   --iothread-cpus|-T <list> Pin iothreads to cpus, e.g. 0-3,8 or node\n");
+    printf("   --node|-N <num>        numa node for buffers (default: the device's,\n");
+    printf("                          -1 for none)\n");
 }
 
+enum Engine {
+    PIPELINE,
+    PERCORE,
+};
+
+struct Pass {
+    Generator::Kind pattern;
+    IOCB::Kind kind;
+    Shard::Order order;
+    bool verify; // writes read back each block, see Config::lag
+    bool preserve; // writes save each block first and put it back after
+    bool scan; // reads without a pattern, only the result counts
+};
+
+struct Config {
+    Engine engine;
+    size_t blocksize;
+    int requests;
+    int batch;
+    Backend::Kind backend_kind;
+    int backend_flags;
+    int spin;
+    int iothreads;
+    Shard::Mode shard_mode;
+    Shard::Order order;
+    int mix;
+    int lag;
+    // requests per second over all lanes, 0 for as fast as possible
+    double rate;
+    std::vector<Pass> passes;
+    // some pass reads and writes at the same time
+    bool split;
+    // only passes that keep the data
+    bool nondestructive;
+    // all passes are scans, lanes need no workers
+    bool scan_only;
+    // latency of scans is reported for this many parts of the device
+    int regions;
+    // parts of the device this many times slower than all of it are slow
+    double slow;
+    int retries;
+    // ms till a request in flight is stuck, 0 for no watchdog
+    int stall;
+    Watchdog::Action stall_action;
+    // --sweep: region, time before and while a cell is measured in ms
+    off_t sweep_size;
+    int warmup;
+    int window;
+    size_t memory;
+    Arena::Pages pages;
+    bool lock;
+    Generator::Kind pattern;
+    uint64_t seed;
+    int workers;
+    int node;
+    CPUList worker_cpus;
+    CPUList iothread_cpus;
+};
+
 class IOCBWorker : public Worker<IOCB, IOCB> {
 public:
-    IOCBWorker(ReadPipe<IOCB> in, WritePipe<IOCB> out)
+    IOCBWorker(ReadRing<IOCB> in, WriteRing<IOCB> out)
 	: Worker(std::move(in), std::move(out)) { }
 private:
     IOCB * work(IOCB * iocb) {
@@ -50,51 +189,1407 @@ private:
     }
 };
 
+// retries requests that failed and passes them on
+class RetryWorker : public Worker<IOCB, IOCB> {
+public:
+    RetryWorker(BadBlocks &bad, ReadRing<IOCB> in, WriteRing<IOCB> out)
+	: Worker(std::move(in), std::move(out)), bad_(bad) { }
+private:
+    IOCB * work(IOCB * iocb) {
+	bad_.retry(iocb);
+	return iocb;
+    }
+
+    BadBlocks &bad_;
+};
+
+/* One slice of the device with its own buffers, workers and iothread,
+ * kept for all passes. Writes are filled by the fillers before the
+ * iothread submits them, reads go straight to the iothread and are
+ * checked by the checkers after they complete. Everything ends up in
+ * the shared out ring.
+ *
+ * A write pass can also read: with config.mix > 0 mix % of the
+ * requests are reads of random blocks whose write already completed,
+ * with pass.verify every block is read back once config.lag more
+ * writes have been issued after it. If any pass does that
+ * (config.split) the workers are split between fillers and checkers,
+ * otherwise both get all of them as only one side is busy at a time.
+ *
+ * A pass with pass.preserve pairs up the buffers into jobs that each
+ * take one block through: read the original into the save buffer,
+ * save it in the journal, write and check the pattern with the test
+ * buffer, write the original back and compare it. The journal is
+ * synced once per batch of saved blocks before their pattern writes
+ * are issued (flush()).
+ *
+ * Requests that fail are retried by the lane's RetryWorker, off the
+ * path of the healthy ones, and rejoin them after the iothread.
+ *
+ * With config.rate > 0 the load is open loop: each request gets the
+ * next slot of a fixed timetable and waits in paced_ till release()
+ * finds its slot has come. A request whose buffer only came back after
+ * its slot had passed missed its deadline, the device is not keeping
+ * up. Either way its response() counts from the slot.
+ *
+ * If all passes are scans (config.scan_only) the lane has no workers,
+ * completions go straight from the iothread to the out ring and the
+ * buffers share SCAN_BUFFERS blocks of memory as nobody looks at the
+ * data.
+ */
+class Lane {
+public:
+    enum { SCAN_BUFFERS = 4 };
+
+    Lane(File &file, const Config &config, Arena &arena, Generator *gen,
+	 Journal *journal, BadBlocks &bad, Watchdog &watchdog, int index,
+	 off_t size, WriteRing<IOCB> out)
+	: config_(config), kind_(IOCB::WRITE), gen_(gen), index_(index),
+	  size_(size), journal_(journal), preserve_(false), unrestored_(0),
+	  unsaved_(0),
+	  shard_(config.shard_mode, index, config.iothreads, size,
+		 config.blocksize),
+	  next_(0), mix_(0), lag_(-1), both_(false),
+	  rng_(mix64(config.seed + index) | 1), written_(0), verified_(0),
+	  ops_(0), reads_(0), interval_(0), slot_(0), missed_(0),
+	  workers_(nullptr), checkers_(nullptr), iothread_(nullptr),
+	  retry_(nullptr) {
+	// split buffers and workers evenly, rest goes to the first lanes
+	int num_iocb = config.memory / config.blocksize;
+	num_iocb = num_iocb / config.iothreads
+	    + (index < num_iocb % config.iothreads);
+	int num_workers = config.workers / config.iothreads
+	    + (index < config.workers % config.iothreads);
+	// global number of our first worker, for pinning
+	int first_worker = index * (config.workers / config.iothreads)
+	    + std::min(index, config.workers % config.iothreads);
+	num_workers = std::max(num_workers, 1);
+	// journal slots, each job of two buffers needs one
+	int total_iocb = config.memory / config.blocksize;
+	first_slot_ = (index * (total_iocb / config.iothreads)
+		       + std::min(index, total_iocb % config.iothreads)) / 2;
+
+	num_iocb_ = num_iocb;
+	int num_bufs = config.scan_only ? std::min(num_iocb, int(SCAN_BUFFERS))
+	    : num_iocb;
+	base_ = (char *)arena.get(num_bufs * config.blocksize);
+	for (int i = 0; i < num_iocb; ++i) {
+	    IOCB * iocb = new IOCB(file, IOCB::WRITE, gen,
+				   base_ + i % num_bufs * config.blocksize,
+				   config.blocksize);
+	    iocb->lane(index);
+	    iocbs_.push_back(iocb);
+	}
+	jobs_.resize(num_iocb / 2);
+	idle_ = iocbs_;
+	Backend *backend = Backend::create(config.backend_kind,
+					   config.requests,
+					   config.backend_flags);
+	backend->register_file(file.fd());
+	// register each block of memory once, the rest shares them
+	std::vector<IOCB *> distinct(iocbs_.begin(),
+				     iocbs_.begin() + num_bufs);
+	backend->register_buffers(distinct);
+	for (int i = num_bufs; i < num_iocb; ++i) {
+	    iocbs_[i]->buf_index(iocbs_[i % num_bufs]->buf_index());
+	}
+
+	RingPair<IOCB> mid = mkring<IOCB>(num_iocb);
+	RingPair<IOCB> failed = mkring<IOCB>(num_iocb);
+	if (config.scan_only) {
+	    retry_ = new RetryWorker(bad, std::move(failed.first), out.dup());
+	    iothread_ = new IOThread(backend, config.batch, config.spin,
+				     watchdog, std::move(mid.first),
+				     std::move(out), std::move(failed.second));
+	    submit_ = std::move(mid.second);
+	    pin_thread(iothread_->thread(), config.iothread_cpus.cpu(index));
+	    return;
+	}
+	RingPair<IOCB> source = mkring<IOCB>(num_iocb);
+	RingPair<IOCB> done = mkring<IOCB>(num_iocb);
+	int fillers = config.split ? std::max(num_workers / 2, 1)
+	    : num_workers;
+	int checkers = config.split ? std::max(num_workers - fillers, 1)
+	    : num_workers;
+	workers_ = new Workers<IOCBWorker>(fillers, std::move(source.first),
+					   mid.second.dup());
+	retry_ = new RetryWorker(bad, std::move(failed.first),
+				 done.second.dup());
+	iothread_ = new IOThread(backend, config.batch, config.spin,
+				 watchdog, std::move(mid.first),
+				 std::move(done.second),
+				 std::move(failed.second));
+	checkers_ = new Workers<IOCBWorker>(checkers, std::move(done.first),
+					    std::move(out));
+	in_ = std::move(source.second);
+	submit_ = std::move(mid.second);
+
+	pin_thread(iothread_->thread(), config.iothread_cpus.cpu(index));
+	for (size_t i = 0; i < workers_->size(); ++i) {
+	    pin_thread((*workers_)[i].thread(),
+		       config.worker_cpus.cpu(first_worker + i));
+	}
+	int first_checker = first_worker + (config.split ? fillers : 0);
+	for (size_t i = 0; i < checkers_->size(); ++i) {
+	    pin_thread((*checkers_)[i].thread(),
+		       config.worker_cpus.cpu(first_checker + i));
+	}
+    }
+
+    ~Lane() {
+	assert(!in_);
+	delete workers_;
+	delete iothread_;
+	delete retry_;
+	delete checkers_;
+    }
+
+    // hand all buffers to the pipeline for one pass over the slice
+    void start(const Pass &pass, Generator *gen) {
+	assert(idle());
+	kind_ = pass.kind;
+	gen_ = gen;
+	shard_ = Shard(config_.shard_mode, index_, config_.iothreads, size_,
+		       config_.blocksize, pass.order, config_.seed);
+	next_ = 0;
+	mix_ = (kind_ == IOCB::WRITE) ? config_.mix : 0;
+	lag_ = ((kind_ == IOCB::WRITE) && pass.verify)
+	    ? std::max(config_.lag, 0) : -1;
+	both_ = (mix_ > 0) || (lag_ >= 0);
+	written_ = 0;
+	done_.clear();
+	verified_ = 0;
+	ops_ = 0;
+	reads_ = 0;
+	preserve_ = pass.preserve;
+	unrestored_ = 0;
+	unsaved_ = 0;
+	// lanes take turns at the slots
+	interval_ = (config_.rate > 0)
+	    ? uint64_t(1e9 * config_.iothreads / config_.rate) : 0;
+	slot_ = now_ns() + index_ * interval_ / config_.iothreads;
+	missed_ = 0;
+	idle_.clear();
+	if (preserve_) {
+	    // an odd buffer out stays idle
+	    if (iocbs_.size() % 2 == 1) idle_.push_back(iocbs_.back());
+	    for (size_t j = 0; j < jobs_.size(); ++j) {
+		begin_job(j);
+	    }
+	    return;
+	}
+	for (IOCB * iocb : iocbs_) {
+	    issue(iocb);
+	}
+    }
+
+    // reuse a completed buffer for the next block or park it
+    void next(IOCB * iocb) {
+	if (preserve_) {
+	    step(iocb);
+	    return;
+	}
+	if (both_ && (iocb->kind() == IOCB::WRITE)) written(iocb->block());
+	issue(iocb);
+	// reads waiting for their write to complete
+	while (!idle_.empty() && verify_due()) {
+	    IOCB * idle = idle_.back();
+	    idle_.pop_back();
+	    issue(idle);
+	}
+    }
+
+    // issue the pattern writes of blocks saved since the journal sync
+    void flush() {
+	for (size_t j : journaled_) {
+	    Job & job = jobs_[j];
+	    job.step = Job::WRITE;
+	    send(iocbs_[2 * j + 1], IOCB::WRITE, gen_, job.block);
+	}
+	journaled_.clear();
+    }
+
+    // blocks of the last preserve pass whose original did not read back
+    uint64_t unrestored() const {
+	return unrestored_;
+    }
+
+    // blocks of the last preserve pass left alone as they did not read
+    uint64_t unsaved() const {
+	return unsaved_;
+    }
+
+    /* submit the requests whose slot has come, returns the slot of the
+     * next one waiting or UINT64_MAX
+     */
+    uint64_t release(uint64_t now) {
+	while (!paced_.empty()) {
+	    IOCB * iocb = paced_.front();
+	    if (iocb->due() > now) return iocb->due();
+	    paced_.pop_front();
+	    submit(iocb);
+	}
+	return UINT64_MAX;
+    }
+
+    // requests of this pass that missed their slot
+    uint64_t missed() const {
+	return missed_;
+    }
+
+    // all buffers are back, the pass is done
+    bool idle() const {
+	return idle_.size() == num_iocb_;
+    }
+
+    // after the last pass, shuts down the pipeline
+    void stop() {
+	assert(idle());
+	if (in_) in_.close();
+	submit_.close();
+	for (IOCB * iocb : iocbs_) delete iocb;
+	iocbs_.clear();
+	idle_.clear();
+    }
+
+    // only valid while idle()
+    const IOThread::Stats & stats() const {
+	return iothread_->stats();
+    }
+private:
+    Lane(Lane &&) = delete;
+    Lane & operator =(Lane &&) = delete;
+
+    // one block of a preserve pass, using iocbs_[2 * j] and [2 * j + 1]
+    struct Job {
+	enum Step {
+	    SAVE,	// read the original into the save buffer
+	    JOURNAL,	// saved, waiting for the journal sync
+	    WRITE,	// write the pattern from the test buffer
+	    CHECK,	// read back and check the pattern
+	    RESTORE,	// write the original from the save buffer
+	    COMPARE,	// read back and compare with the save buffer
+	};
+	uint64_t block;
+	Step step;
+    };
+
+    void begin_job(size_t j) {
+	IOCB * save = iocbs_[2 * j];
+	IOCB * test = iocbs_[2 * j + 1];
+	if (next_ >= shard_.blocks()) {
+	    idle_.push_back(save);
+	    idle_.push_back(test);
+	    return;
+	}
+	Job & job = jobs_[j];
+	job.block = next_++;
+	job.step = Job::SAVE;
+	send(save, IOCB::READ, nullptr, job.block);
+    }
+
+    // move the job of a completed buffer on to its next step
+    void step(IOCB * iocb) {
+	size_t j = ((char *)iocb->buf() - base_) / config_.blocksize / 2;
+	Job & job = jobs_[j];
+	IOCB * save = iocbs_[2 * j];
+	IOCB * test = iocbs_[2 * j + 1];
+	switch (job.step) {
+	case Job::SAVE:
+	    if (save->result() != long(config_.blocksize)) {
+		/* the retry has put the bad sectors in the extents, the
+		 * buffer still holds another block, never write it back
+		 */
+		fprintf(stderr, "Save error in block at %#lx: left"
+			" untouched\n", save->offset());
+		++unsaved_;
+		begin_job(j);
+		break;
+	    }
+	    job.step = Job::JOURNAL;
+	    if (journal_ != nullptr) {
+		journal_->save(first_slot_ + j, save->offset(), save->buf());
+	    }
+	    journaled_.push_back(j);
+	    break;
+	case Job::JOURNAL:
+	    assert(false);
+	    break;
+	case Job::WRITE:
+	    job.step = Job::CHECK;
+	    send(test, IOCB::READ, gen_, job.block);
+	    break;
+	case Job::CHECK:
+	    job.step = Job::RESTORE;
+	    send(save, IOCB::WRITE, nullptr, job.block);
+	    break;
+	case Job::RESTORE:
+	    job.step = Job::COMPARE;
+	    send(test, IOCB::READ, nullptr, job.block);
+	    break;
+	case Job::COMPARE:
+	    if (memcmp(test->buf(), save->buf(), config_.blocksize) != 0) {
+		// keep it in the journal for --restore
+		fprintf(stderr, "Restore error in block at %#lx: original"
+			" data did not read back\n", test->offset());
+		++unrestored_;
+	    } else if (journal_ != nullptr) {
+		journal_->clear(first_slot_ + j);
+	    }
+	    begin_job(j);
+	    break;
+	}
+    }
+
+    void issue(IOCB * iocb) {
+	IOCB::Kind kind = kind_;
+	uint64_t n;
+	if (verify_due()) {
+	    kind = IOCB::READ;
+	    n = verified_++;
+	} else if (next_ < shard_.blocks()) {
+	    if ((mix_ > 0) && read_turn()) {
+		kind = IOCB::READ;
+		n = random() % written_;
+	    } else {
+		n = next_++;
+	    }
+	} else {
+	    // nothing left or waiting for the last writes to complete
+	    idle_.push_back(iocb);
+	    return;
+	}
+	send(iocb, kind, gen_, n);
+    }
+
+    void send(IOCB * iocb, IOCB::Kind kind, Generator *gen, uint64_t n) {
+	iocb->kind(kind);
+	iocb->gen(gen);
+	iocb->block(n);
+	iocb->offset(shard_.offset(n));
+	if (interval_ > 0) {
+	    iocb->due(slot_);
+	    if (slot_ < now_ns()) ++missed_;
+	    slot_ += interval_;
+	    paced_.push_back(iocb);
+	    return;
+	}
+	submit(iocb);
+    }
+
+    void submit(IOCB * iocb) {
+	if ((iocb->kind() == IOCB::READ) || (iocb->gen() == nullptr)) {
+	    // nothing to fill, skip the fillers
+	    iocb->fill();
+	    submit_.write(iocb);
+	} else {
+	    in_.write(iocb);
+	}
+    }
+
+    // the oldest unverified block is complete and lag_ writes behind
+    bool verify_due() const {
+	return (lag_ >= 0) && (verified_ < written_)
+	    && ((next_ >= verified_ + 1 + lag_)
+		|| (next_ >= shard_.blocks()));
+    }
+
+    // reads make up mix_ % of the requests once something is written
+    bool read_turn() {
+	if (written_ == 0) return false;
+	++ops_;
+	if (reads_ * 100 >= ops_ * mix_) return false;
+	++reads_;
+	return true;
+    }
+
+    // advance written_ over all blocks completed in a row
+    void written(uint64_t n) {
+	done_.insert(n);
+	while (!done_.empty() && (*done_.begin() == written_)) {
+	    done_.erase(done_.begin());
+	    ++written_;
+	}
+    }
+
+    uint64_t random() {
+	rng_ ^= rng_ << 13;
+	rng_ ^= rng_ >> 7;
+	rng_ ^= rng_ << 17;
+	return rng_;
+    }
+
+    const Config &config_;
+    IOCB::Kind kind_;
+    Generator *gen_;
+    int index_;
+    off_t size_;
+    Journal *journal_;
+    size_t first_slot_;
+    bool preserve_;
+    uint64_t unrestored_;
+    uint64_t unsaved_;
+    char *base_;
+    // all buffers, in arena order
+    std::vector<IOCB *> iocbs_;
+    std::vector<Job> jobs_;
+    // jobs saved to the journal since the last flush()
+    std::vector<size_t> journaled_;
+    Shard shard_;
+    uint64_t next_;
+    int mix_;
+    int lag_;
+    bool both_;
+    uint64_t rng_;
+    // blocks [0, written_) and done_ have completed
+    uint64_t written_;
+    std::set<uint64_t> done_;
+    // blocks [0, verified_) have been read back
+    uint64_t verified_;
+    uint64_t ops_;
+    uint64_t reads_;
+    // open loop: ns between slots, the next free slot
+    uint64_t interval_;
+    uint64_t slot_;
+    uint64_t missed_;
+    // prepared requests waiting for their slot, in slot order
+    std::deque<IOCB *> paced_;
+    size_t num_iocb_;
+    // buffers not in the pipeline
+    std::vector<IOCB *> idle_;
+    Workers<IOCBWorker> *workers_;
+    Workers<IOCBWorker> *checkers_;
+    IOThread *iothread_;
+    RetryWorker *retry_;
+    WriteRing<IOCB> in_;
+    WriteRing<IOCB> submit_;
+};
+
 volatile bool print_completed = true;
 
 void alarm_action(int, siginfo_t *, void *) {
     print_completed = true;
 }
 
-double diff(struct timeval & start, struct timeval & end) {
-    return end.tv_sec - start.tv_sec
-	+ (double(end.tv_usec) - start.tv_usec) / 1000000;
+static const off_t MEGA = 1024 * 1024;
+// slow regions listed per pass and direction, the heatmap has them all
+static const size_t SLOW_REGIONS = 16;
+
+/* once a second progress output, with the requests that stalled
+ * since the start if there are any
+ */
+class Progress {
+public:
+    Progress(const char *phase, off_t size, const Watchdog &watchdog)
+	: phase_(phase), size_(size), completed_(0), last_completed_(0),
+	  start_(now_ns()), last_(start_), watchdog_(watchdog),
+	  before_(watchdog.counts()) {
+	print_completed = false;
+    }
+
+    void add(off_t bytes) {
+	completed_ += bytes;
+	if (print_completed) {
+	    print_completed = false;
+	    print();
+	}
+    }
+
+    void done() {
+	if (last_completed_ != completed_) print();
+    }
+
+    // seconds since start
+    double elapsed() {
+	return (now_ns() - start_) / 1e9;
+    }
+private:
+    void print() {
+	uint64_t now = now_ns();
+	Watchdog::Counts counts = watchdog_.counts();
+	uint64_t stalls = counts.stalls - before_.stalls;
+	char stalled[64] = "";
+	if ((stalls > 0) || (counts.stuck > 0)) {
+	    snprintf(stalled, sizeof(stalled), " [ %lu stalled, %lu stuck ]",
+		     stalls, counts.stuck);
+	}
+	fprintf(stderr,
+		"%f : %s completed = %lu MiB / %lu MiB [ %f MiB/s ]%s\n",
+		(now - start_) / 1e9, phase_,
+		completed_ / MEGA, size_ / MEGA,
+		(completed_ - last_completed_) / 1024.0 / 1024.0
+		/ ((now - last_) / 1e9), stalled);
+	last_completed_ = completed_;
+	last_ = now;
+    }
+
+    const char *phase_;
+    off_t size_;
+    off_t completed_;
+    off_t last_completed_;
+    // monotonic, in ns
+    uint64_t start_;
+    uint64_t last_;
+    const Watchdog &watchdog_;
+    Watchdog::Counts before_;
+};
+
+void print_stats(const char *phase, const IOThread::Stats & stats) {
+    printf("%s: %lu submit calls [ %.1f requests per call ], "
+	   "%lu reap calls [ %.1f events per call ], %lu sleeps\n",
+	   phase,
+	   stats.submit_calls,
+	   double(stats.submitted) / std::max(stats.submit_calls, 1UL),
+	   stats.reap_calls,
+	   double(stats.reaped) / std::max(stats.reap_calls, 1UL),
+	   stats.sleeps);
+}
+
+void print_errors(const char *phase, const Generator::Errors & errors) {
+    printf("%s: %lu corrupt, %lu misdirected, %lu stale sectors,"
+	   " %lu torn blocks\n", phase, errors.corrupt, errors.misdirected, errors.stale,
+	   errors.torn);
+}
+
+void print_bad(const char *phase, BadBlocks &bad) {
+    BadBlocks::Counts counts = bad.counts();
+    printf("%s: %lu failed requests, %lu bad sectors\n", phase,
+	   counts.failed, counts.bad);
+}
+
+// requests that stalled since before was taken
+void print_stalls(const char *phase, const Watchdog &watchdog,
+		  const Watchdog::Counts &before) {
+    if (watchdog.stall() == 0) return;
+    Watchdog::Counts counts = watchdog.counts();
+    printf("%s: %lu requests stalled for %.3f s or more, %lu cancelled\n",
+	   phase, counts.stalls - before.stalls, watchdog.stall() / 1e9,
+	   counts.cancelled - before.cancelled);
+}
+
+// response is nullptr unless the load was open loop
+void print_latency(const char *phase, const Latency latency[2],
+		   const Histogram histogram[2], const Histogram *response,
+		   double seconds) {
+    if (latency[IOCB::WRITE].ops() > 0) {
+	latency[IOCB::WRITE].print(phase, "write", seconds);
+	histogram[IOCB::WRITE].print(phase, "write latency");
+	if (response) response[IOCB::WRITE].print(phase, "write response");
+    }
+    if (latency[IOCB::READ].ops() > 0) {
+	latency[IOCB::READ].print(phase, "read", seconds);
+	histogram[IOCB::READ].print(phase, "read latency");
+	if (response) response[IOCB::READ].print(phase, "read response");
+    }
+}
+
+/* slow regions of each direction, pass n, all regions also go to
+ * heatmap unless it is nullptr
+ */
+void print_regions(const char *phase, const Regions regions[2],
+		   const Config &config, FILE *heatmap, size_t n) {
+    for (IOCB::Kind kind : {IOCB::WRITE, IOCB::READ}) {
+	if (regions[kind].ops() == 0) continue;
+	const char *dir = (kind == IOCB::READ) ? "read" : "write";
+	regions[kind].print_slow(phase, dir, config.slow, SLOW_REGIONS);
+	if (heatmap != nullptr) {
+	    regions[kind].write(heatmap, n + 1, phase, dir, config.slow);
+	}
+    }
+}
+
+/* out.read_batch() for an open loop: submits the requests whose slot
+ * has come while it waits and sleeps no longer than till the next slot.
+ * The last spin us of a wait are spun for a more punctual submit.
+ */
+size_t read_paced(std::vector<Lane *> &lanes, ReadRing<IOCB> &out,
+		  IOCB **iocbs, size_t max, int spin) {
+    uint64_t spin_ns = spin * 1000ULL;
+    while (true) {
+	uint64_t now = now_ns();
+	uint64_t wake = UINT64_MAX;
+	for (Lane * lane : lanes) {
+	    wake = std::min(wake, lane->release(now));
+	}
+	size_t num = out.try_read_batch(iocbs, max);
+	if (num > 0) return num;
+	if ((wake != UINT64_MAX) && (wake <= now + spin_ns)) continue;
+	if (!out.sleep_begin()) continue;
+	struct pollfd pfd = { out.fd(), POLLIN, 0 };
+	uint64_t sleep = (wake == UINT64_MAX) ? 0 : wake - now - spin_ns;
+	struct timespec timeout = {
+	    time_t(sleep / 1000000000), long(sleep % 1000000000)
+	};
+	int res = ppoll(&pfd, 1, (wake == UINT64_MAX) ? nullptr : &timeout,
+			nullptr);
+	if ((res == -1) && (errno != EINTR)) {
+	    perror(__PRETTY_FUNCTION__);
+	    assert(false);
+	}
+	out.sleep_end(res == 1);
+    }
+}
+
+void add_stats(IOThread::Stats & sum, const IOThread::Stats & stats) {
+    sum.submit_calls += stats.submit_calls;
+    sum.submitted += stats.submitted;
+    sum.reap_calls += stats.reap_calls;
+    sum.reaped += stats.reaped;
+    sum.sleeps += stats.sleeps;
+}
+
+void sub_stats(IOThread::Stats & diff, const IOThread::Stats & stats) {
+    diff.submit_calls -= stats.submit_calls;
+    diff.submitted -= stats.submitted;
+    diff.reap_calls -= stats.reap_calls;
+    diff.reaped -= stats.reaped;
+    diff.sleeps -= stats.sleeps;
+}
+
+const char * pass_name(const Pass &pass, const Config &config) {
+    if (pass.scan) return "scan";
+    if (pass.kind == IOCB::READ) return "read";
+    if (pass.verify) return "verify";
+    if (pass.preserve) return "preserve";
+    return (config.mix > 0) ? "mixed" : "write";
+}
+
+void print_pass(const Config &config, size_t n) {
+    const Pass &pass = config.passes[n];
+    printf("pass %zu/%zu: %s %s %s\n", n + 1, config.passes.size(),
+	   pass.scan ? "no pattern," : Generator::name(pass.pattern),
+	   pass_name(pass, config), Shard::name(pass.order));
+}
+
+/* write or read the whole device once, writes mixed with reads of
+ * what was written if config.mix > 0 or pass.verify, or test it
+ * without losing the data if pass.preserve, gen is nullptr for scans,
+ * pass n of config.passes for the heatmap
+ */
+void run_pass(const Pass &pass, const Config &config, Generator *gen,
+	      Journal *journal, BadBlocks &bad, const Watchdog &watchdog,
+	      FILE *heatmap, size_t n, std::vector<Lane *> &lanes,
+	      ReadRing<IOCB> &out, off_t size) {
+    const char *phase = pass_name(pass, config);
+    // completions taken off out at a time, bounds the stack used
+    enum { BATCH = 256 };
+    bool mixed = (pass.kind == IOCB::WRITE) && (config.mix > 0)
+	&& !pass.preserve;
+
+    // the iothreads keep counting across passes
+    IOThread::Stats before = IOThread::Stats();
+    for (Lane * lane : lanes) {
+	add_stats(before, lane->stats());
+    }
+
+    // the reads come on top of the size written
+    off_t total = mixed ? size / (100 - config.mix) * 100 : size;
+    if (pass.verify) total += size;
+    // save, write, check, restore and compare
+    if (pass.preserve) total = 5 * size;
+    Watchdog::Counts stalls = watchdog.counts();
+    Progress progress(phase, total, watchdog);
+    size_t busy = 0;
+    for (Lane * lane : lanes) {
+	lane->start(pass, gen);
+	if (!lane->idle()) ++busy;
+    }
+
+    // recycle buffers till all lanes are idle again
+    IOCB * iocbs[BATCH];
+    Latency latency[2];
+    Histogram histogram[2];
+    Histogram response[2];
+    bool paced = config.rate > 0;
+    Regions regions[2] = {
+	{ size, config.blocksize }, { size, config.blocksize }
+    };
+    while (busy > 0) {
+	size_t num = paced
+	    ? read_paced(lanes, out, iocbs, BATCH, config.spin)
+	    : out.read_batch(iocbs, BATCH);
+	assert(num > 0);
+	for (size_t i = 0; i < num; ++i) {
+	    IOCB * iocb = iocbs[i];
+	    // scan only lanes have no checkers
+	    if (iocb->state() == IOCB::SUBMITTED) iocb->check();
+	    latency[iocb->kind()].add(iocb->latency(), iocb->size());
+	    histogram[iocb->kind()].add(iocb->latency());
+	    if (paced) response[iocb->kind()].add(iocb->response());
+	    regions[iocb->kind()].add(iocb->offset(), iocb->started(),
+				      iocb->finished(), iocb->size());
+	    progress.add(iocb->size());
+	    Lane * lane = lanes[iocb->lane()];
+	    lane->next(iocb);
+	    if (lane->idle()) --busy;
+	}
+	if (pass.preserve) {
+	    // one sync for everything saved in the batch
+	    if (journal != nullptr) journal->sync();
+	    for (Lane * lane : lanes) {
+		lane->flush();
+	    }
+	}
+    }
+    progress.done();
+    double seconds = progress.elapsed();
+
+    IOThread::Stats stats = IOThread::Stats();
+    for (Lane * lane : lanes) {
+	add_stats(stats, lane->stats());
+    }
+    sub_stats(stats, before);
+    print_stats(phase, stats);
+    print_latency(phase, latency, histogram, paced ? response : nullptr,
+		  seconds);
+    print_regions(phase, regions, config, heatmap, n);
+    if (paced) {
+	uint64_t missed = 0;
+	for (Lane * lane : lanes) {
+	    missed += lane->missed();
+	}
+	printf("%s: paced at %.0f requests/s, %lu missed their slot\n",
+	       phase, config.rate, missed);
+    }
+    print_bad(phase, bad);
+    print_stalls(phase, watchdog, stalls);
+    if (pass.scan) {
+	regions[IOCB::READ].print(phase, "read", config.regions);
+    } else if ((pass.kind == IOCB::READ) || mixed || pass.verify
+	       || pass.preserve) {
+	print_errors(phase, gen->errors());
+    }
+    if (pass.preserve) {
+	uint64_t unrestored = 0;
+	uint64_t unsaved = 0;
+	for (Lane * lane : lanes) {
+	    unrestored += lane->unrestored();
+	    unsaved += lane->unsaved();
+	}
+	printf("%s: %lu blocks not restored, %lu unreadable ones left"
+	       " untouched\n", phase, unrestored, unsaved);
+    }
+}
+
+/* run all passes through one set of lanes, buffers, threads and
+ * backends, gens holds the generator for each pattern used, journal
+ * and heatmap may be nullptr
+ */
+void run_pipeline(File &file, const Config &config, Arena &arena,
+		  Generator * const gens[], Journal *journal, BadBlocks &bad,
+		  Watchdog &watchdog, FILE *heatmap, off_t size) {
+    int num_iocb = config.memory / config.blocksize;
+    RingPair<IOCB> drain = mkring<IOCB>(num_iocb);
+    arena.reset();
+
+    std::vector<Lane *> lanes;
+    Generator *first = gens[config.passes[0].pattern];
+    for (int i = 0; i < config.iothreads; ++i) {
+	lanes.push_back(new Lane(file, config, arena, first, journal, bad,
+				 watchdog, i, size, drain.second.dup()));
+    }
+    drain.second.close();
+    ReadRing<IOCB> out = std::move(drain.first);
+
+    uint64_t writes = 0;
+    for (size_t n = 0; n < config.passes.size(); ++n) {
+	const Pass &pass = config.passes[n];
+	Generator *gen = pass.scan ? nullptr : gens[pass.pattern];
+	print_pass(config, n);
+	// reads expect what the last write with the pattern left
+	if (pass.kind == IOCB::WRITE) gen->pass(writes++);
+	run_pass(pass, config, gen, journal, bad, watchdog, heatmap, n,
+		 lanes, out, size);
+    }
+
+    for (Lane * lane : lanes) {
+	lane->stop();
+	delete lane;
+    }
+}
+
+/* same with one CoreThread per slice doing all the work, they signal
+ * done when they finished their share of the pass
+ */
+void run_pass_percore(const Pass &pass, const Config &config,
+		      Generator *gen, BadBlocks &bad, Watchdog &watchdog,
+		      FILE *heatmap, size_t n,
+		      std::vector<CoreThread *> &threads, EventFD &done,
+		      off_t size) {
+    IOCB::Kind kind = pass.kind;
+    const char *phase = pass_name(pass, config);
+
+    Watchdog::Counts stalls = watchdog.counts();
+    Progress progress(phase, size, watchdog);
+    // shared by the threads
+    Regions regions[2] = {
+	{ size, config.blocksize }, { size, config.blocksize }
+    };
+    for (int i = 0; i < config.iothreads; ++i) {
+	Shard shard(config.shard_mode, i, config.iothreads, size,
+		    config.blocksize, pass.order, config.seed);
+	threads[i]->start(kind, gen, shard, regions[kind]);
+    }
+
+    // sum up progress till all threads are done
+    int finished = 0;
+    off_t completed = 0;
+    while (finished < config.iothreads) {
+	struct pollfd pfd = { done.fd(), POLLIN, 0 };
+	int res = poll(&pfd, 1, -1);
+	if (res == -1) {
+	    if (errno != EINTR) {
+		perror(__PRETTY_FUNCTION__);
+		assert(false);
+	    }
+	} else {
+	    finished += done.read();
+	}
+	off_t sum = 0;
+	for (CoreThread * thread : threads) {
+	    sum += thread->completed();
+	}
+	progress.add(sum - completed);
+	completed = sum;
+    }
+    progress.done();
+    double seconds = progress.elapsed();
+
+    IOThread::Stats stats = IOThread::Stats();
+    Latency latency[2];
+    Histogram histogram[2];
+    for (CoreThread * thread : threads) {
+	add_stats(stats, thread->stats());
+	latency[kind].add(thread->latency());
+	histogram[kind].add(thread->histogram());
+    }
+    print_stats(phase, stats);
+    print_latency(phase, latency, histogram, nullptr, seconds);
+    print_regions(phase, regions, config, heatmap, n);
+    print_bad(phase, bad);
+    print_stalls(phase, watchdog, stalls);
+    if (pass.scan) {
+	regions[IOCB::READ].print(phase, "read", config.regions);
+    } else if (kind == IOCB::READ) {
+	print_errors(phase, gen->errors());
+    }
+}
+
+/* run all passes through one set of CoreThreads with their buffers and
+ * backends, gens holds the generator for each pattern used, heatmap
+ * may be nullptr
+ */
+void run_percore(File &file, const Config &config, Arena &arena,
+		 Generator * const gens[], BadBlocks &bad, Watchdog &watchdog,
+		 FILE *heatmap, off_t size) {
+    int num_iocb = config.memory / config.blocksize;
+    EventFD done;
+    arena.reset();
+
+    std::vector<CoreThread *> threads;
+    std::vector<RetryWorker *> retries;
+    for (int i = 0; i < config.iothreads; ++i) {
+	Backend *backend = Backend::create(config.backend_kind,
+					   config.requests,
+					   config.backend_flags);
+	int num = num_iocb / config.iothreads;
+	char *buf = (char *)arena.get(num * config.blocksize);
+	RingPair<IOCB> failed = mkring<IOCB>(num);
+	RingPair<IOCB> retried = mkring<IOCB>(num);
+	retries.push_back(new RetryWorker(bad, std::move(failed.first),
+					  std::move(retried.second)));
+	threads.push_back(new CoreThread(file, watchdog, backend, num,
+					 config.blocksize, config.batch,
+					 config.spin,
+					 config.iothread_cpus.cpu(i), buf,
+					 std::move(failed.second),
+					 std::move(retried.first), done));
+    }
+
+    uint64_t writes = 0;
+    for (size_t n = 0; n < config.passes.size(); ++n) {
+	const Pass &pass = config.passes[n];
+	Generator *gen = pass.scan ? nullptr : gens[pass.pattern];
+	print_pass(config, n);
+	// reads expect what the last write with the pattern left
+	if (pass.kind == IOCB::WRITE) gen->pass(writes++);
+	run_pass_percore(pass, config, gen, bad, watchdog, heatmap, n,
+			 threads, done, size);
+    }
+
+    // the threads close the rings their RetryWorker waits on
+    for (CoreThread * thread : threads) {
+	delete thread;
+    }
+    for (RetryWorker * retry : retries) {
+	delete retry;
+    }
+}
+
+bool parse_pattern(const char *str, Generator::Kind &kind) {
+    for (Generator::Kind k : {Generator::OFFSET, Generator::RANDOM,
+		Generator::BADBLOCKS, Generator::HEADER, Generator::CRC}) {
+	if (strcmp(str, Generator::name(k)) == 0) {
+	    kind = k;
+	    return true;
+	}
+    }
+    return false;
+}
+
+bool parse_stall_action(const char *str, Watchdog::Action &action) {
+    for (Watchdog::Action a : {Watchdog::REPORT, Watchdog::CANCEL,
+		Watchdog::ABORT}) {
+	if (strcmp(str, Watchdog::name(a)) == 0) {
+	    action = a;
+	    return true;
+	}
+    }
+    return false;
+}
+
+bool parse_order(const char *str, Shard::Order &order) {
+    if (strcmp(str, "sequential") == 0) {
+	order = Shard::SEQUENTIAL;
+    } else if (strcmp(str, "random") == 0) {
+	order = Shard::RANDOM;
+    } else {
+	return false;
+    }
+    return true;
+}
+
+/* Comma separated
+ * pattern[:write|read|verify|preserve][:sequential|random] or
+ * scan[:sequential|random], direction defaults to write (preserve if
+ * config.nondestructive) and order to config.order. "badblocks" alone
+ * is badblocks -w: 0xaa, 0x55, 0xff and 0x00 each written and read
+ * back, or badblocks -n: each preserved. Returns false on error.
+ */
+bool parse_passes(const char *str, const Config &config,
+		  std::vector<Pass> &passes) {
+    bool keep = config.nondestructive;
+    if (strcmp(str, "badblocks") == 0) {
+	for (int i = 0; i < 4; ++i) {
+	    passes.push_back(Pass{Generator::BADBLOCKS, IOCB::WRITE,
+				  config.order, false, keep, false});
+	    if (keep) continue;
+	    passes.push_back(Pass{Generator::BADBLOCKS, IOCB::READ,
+				  config.order, false, false, false});
+	}
+	return true;
+    }
+    std::stringstream list(str);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+	std::stringstream fields(item);
+	std::string field;
+	Pass pass = {config.pattern, IOCB::WRITE, config.order, false, keep,
+		     false};
+	std::getline(fields, field, ':');
+	if (field == "scan") {
+	    pass.kind = IOCB::READ;
+	    pass.preserve = false;
+	    pass.scan = true;
+	} else if (!parse_pattern(field.c_str(), pass.pattern)) {
+	    return false;
+	}
+	while (std::getline(fields, field, ':')) {
+	    if (parse_order(field.c_str(), pass.order)) continue;
+	    // a scan has no direction
+	    if (pass.scan) return false;
+	    if (field == "write") {
+		pass.kind = IOCB::WRITE;
+		pass.verify = false;
+		pass.preserve = false;
+	    } else if (field == "read") {
+		pass.kind = IOCB::READ;
+		pass.verify = false;
+		pass.preserve = false;
+	    } else if (field == "verify") {
+		pass.kind = IOCB::WRITE;
+		pass.verify = true;
+		pass.preserve = false;
+	    } else if (field == "preserve") {
+		pass.kind = IOCB::WRITE;
+		pass.verify = false;
+		pass.preserve = true;
+	    } else {
+		return false;
+	    }
+	}
+	passes.push_back(pass);
+    }
+    return !passes.empty();
+}
+
+/* [read|write:]depth,...:blocksize,... of --sweep, depths end up
+ * ascending, returns false on error
+ */
+bool parse_sweep(const char *str, IOCB::Kind &kind,
+		 std::vector<int> &depths, std::vector<size_t> &sizes) {
+    std::stringstream fields(str);
+    std::vector<std::string> field;
+    std::string f;
+    while (std::getline(fields, f, ':')) field.push_back(f);
+    if (field.size() == 3) {
+	if (field[0] == "read") {
+	    kind = IOCB::READ;
+	} else if (field[0] == "write") {
+	    kind = IOCB::WRITE;
+	} else {
+	    return false;
+	}
+	field.erase(field.begin());
+    }
+    if (field.size() != 2) return false;
+    for (int i = 0; i < 2; ++i) {
+	std::stringstream list(field[i]);
+	std::string item;
+	while (std::getline(list, item, ',')) {
+	    char *end;
+	    long long num = strtoll(item.c_str(), &end, 0);
+	    if ((*end != 0) || (num <= 0)) return false;
+	    if (i == 0) {
+		depths.push_back(num);
+	    } else {
+		sizes.push_back(num);
+	    }
+	}
+    }
+    std::sort(depths.begin(), depths.end());
+    return !depths.empty() && !sizes.empty();
+}
+
+/* --sweep: all cells of the grid share one backend and one arena
+ * big enough for the largest of them
+ */
+void run_sweep(const char *cmd, const char *name, const Config &config,
+	       const char *spec, const char *output) {
+    IOCB::Kind kind = IOCB::READ;
+    std::vector<int> depths;
+    std::vector<size_t> sizes;
+    if (!parse_sweep(spec, kind, depths, sizes)) {
+	fprintf(stderr, "Error: bad sweep '%s'\n", spec);
+	exit(1);
+    }
+    if ((kind == IOCB::WRITE) && config.nondestructive) {
+	fprintf(stderr, "Error: --nondestructive only allows read sweeps\n");
+	exit(1);
+    }
+    if ((config.warmup < 0) || (config.window <= 0)) {
+	fprintf(stderr, "Error: need a window and no negative warmup\n");
+	exit(1);
+    }
+
+    File file(name);
+    Extents extents;
+    BadBlocks bad(file, config.retries, extents);
+    Watchdog watchdog(config.stall * 1000000ULL, config.stall_action);
+    size_t max_size = *std::max_element(sizes.begin(), sizes.end());
+    for (size_t size : sizes) {
+	if (size % bad.sector_size() != 0) {
+	    fprintf(stderr, "Error: sweep block size %zu is not a multiple"
+		    " of the sector size %zu\n", size, bad.sector_size());
+	    exit(1);
+	}
+    }
+    off_t size = std::min(config.sweep_size, file.size());
+    size = size / max_size * max_size;
+    if (size == 0) {
+	fprintf(stderr, "Error: sweep region smaller than %zu\n", max_size);
+	exit(1);
+    }
+    int node = (config.node == -2) ? device_node(file) : config.node;
+    size_t memory = depths.back() * max_size;
+    Arena arena(memory + Arena::ALIGN, config.pages, config.lock, node);
+    Backend *backend = Backend::create(config.backend_kind, depths.back(),
+				       config.backend_flags);
+
+    printf("%s V0.0\n", cmd);
+    printf("sweep     = %s %s, %zu cells\n",
+	   (kind == IOCB::READ) ? "read" : "write", spec,
+	   depths.size() * sizes.size());
+    printf("region    = %#lx\n", size);
+    printf("backend   = %s%s%s\n", Backend::name(config.backend_kind),
+	   (config.backend_flags & Backend::SQPOLL) ? " sqpoll" : "",
+	   (config.backend_flags & Backend::IOPOLL) ? " iopoll" : "");
+    printf("order     = %s\n", Shard::name(config.order));
+    printf("window    = %d ms after %d ms warmup\n", config.window,
+	   config.warmup);
+    printf("arena     = %#lx (%s%s)\n", arena.size(),
+	   Arena::name(arena.pages()), arena.locked() ? ", locked" : "");
+
+    Sweep grid(file, backend, bad, watchdog, kind, (char *)arena.get(memory),
+	       memory, size, config.order, config.seed,
+	       config.warmup * 1000000ULL, config.window * 1000000ULL);
+    grid.run(depths, sizes);
+    grid.print();
+    if ((output != nullptr) && !grid.write(output)) {
+	fprintf(stderr, "Error: writing '%s': %s\n", output,
+		strerror(errno));
+	exit(1);
+    }
+    extents.print(32);
 }
 
 int main(int argc, char * const argv []) {
-    size_t blocksize = 4096;
-    int requests = 16;
-    size_t memory = 0;
-    int num_workers = 1;
-    static const off_t MEGA = 1024 * 1024;
+    Config config;
+    config.engine = PIPELINE;
+    config.blocksize = 4096;
+    config.requests = 16;
+    config.batch = 0;
+    config.backend_kind = Backend::AIO;
+    config.backend_flags = 0;
+    config.spin = 0;
+    config.iothreads = 1;
+    config.shard_mode = Shard::STRIPE;
+    config.order = Shard::SEQUENTIAL;
+    config.mix = 0;
+    config.rate = 0;
+    double bandwidth = 0;
+    config.lag = -1;
+    config.memory = 0;
+    config.pages = Arena::SMALL;
+    config.lock = false;
+    config.pattern = Generator::OFFSET;
+    config.seed = std::random_device()();
+    config.seed = (config.seed << 32) | std::random_device()();
+    config.workers = 1;
+    config.node = -2; // device's node
+    const char *worker_cpus = nullptr;
+    const char *iothread_cpus = nullptr;
+    const char *passes = nullptr;
+    const char *journal_path = nullptr;
+    const char *bad_list = nullptr;
+    bool restore = false;
+    config.nondestructive = false;
+    config.regions = 16;
+    config.slow = 3;
+    const char *heatmap_path = nullptr;
+    config.retries = 2;
+    config.stall = 10000;
+    config.stall_action = Watchdog::REPORT;
+    config.sweep_size = off_t(1) << 30;
+    config.warmup = 200;
+    config.window = 1000;
+    const char *sweep = nullptr;
+    const char *sweep_output = nullptr;
 
     while (true) {
 	static struct option long_options[] = {
+	    {"backend",   required_argument, 0,  'I'},
+	    {"batch",     required_argument, 0,  'B'},
 	    {"blocksize", required_argument, 0,  'b'},
+	    {"engine",    required_argument, 0,  'e'},
+	    {"pattern",   required_argument, 0,  'D'},
+	    {"hugepages", required_argument, 0,  'H'},
+	    {"iothreads", required_argument, 0,  't'},
 	    {"memory",    required_argument, 0,  'm'},
+	    {"mix",       required_argument, 0,  'M'},
+	    {"iops",      required_argument, 0,  'q'},
+	    {"bandwidth", required_argument, 0,  'Q'},
+	    {"verify-lag", required_argument, 0, 'V'},
+	    {"order",     required_argument, 0,  'o'},
+	    {"passes",    required_argument, 0,  'x'},
+	    {"nondestructive", no_argument,  0,  'n'},
+	    {"journal",   required_argument, 0,  'j'},
+	    {"restore",   no_argument,       0,  'u'},
+	    {"regions",   required_argument, 0,  'G'},
+	    {"slow",      required_argument, 0,  'f'},
+	    {"heatmap",   required_argument, 0,  'a'},
+	    {"retries",   required_argument, 0,  'y'},
+	    {"bad-list",  required_argument, 0,  'O'},
+	    {"stall",     required_argument, 0,  'C'},
+	    {"stall-action", required_argument, 0, 'A'},
+	    {"poll",      required_argument, 0,  'p'},
 	    {"requests",  required_argument, 0,  'r'},
+	    {"seed",      required_argument, 0,  'R'},
+	    {"shard",     required_argument, 0,  's'},
 	    {"workers",   required_argument, 0,  'w'},
+	    {"worker-cpus",   required_argument, 0,  'W'},
+	    {"iothread-cpus", required_argument, 0,  'T'},
+	    {"node",      required_argument, 0,  'N'},
+	    {"sweep",     required_argument, 0,  'X'},
+	    {"sweep-size", required_argument, 0, 'Z'},
+	    {"warmup",    required_argument, 0,  'K'},
+	    {"window",    required_argument, 0,  'J'},
+	    {"sweep-output", required_argument, 0, 'F'},
+	    {"iopoll",    no_argument,       0,  'P'},
+	    {"mlock",     no_argument,       0,  'L'},
+	    {"sqpoll",    no_argument,       0,  'S'},
 	    {"help",      no_argument,       0,  'h'},
 	    {0,           0,                 0,   0 },
 	};
 	int option_index = 0;
 
-	int c = getopt_long(argc, argv, "b:hm:r:w:",
+	int c = getopt_long(argc, argv, "A:a:B:b:C:D:e:F:f:G:H:hI:J:j:K:LM:m:N:nO:o:Pp:Q:q:R:r:Ss:T:t:uV:W:w:X:x:y:Z:",
 			    long_options, &option_index);
 	if (c == -1)
 	    break;
 	switch (c) {
+	case 'B':
+	    config.batch = atoi(optarg);
+	    break;
 	case 'b':
-	    blocksize = atoll(optarg);
+	    config.blocksize = atoll(optarg);
+	    break;
+	case 'D':
+	    if (!parse_pattern(optarg, config.pattern)) {
+		fprintf(stderr, "Error: unknown pattern '%s'\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'e':
+	    if (strcmp(optarg, "pipeline") == 0) {
+		config.engine = PIPELINE;
+	    } else if (strcmp(optarg, "percore") == 0) {
+		config.engine = PERCORE;
+	    } else {
+		fprintf(stderr, "Error: unknown engine '%s'\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'H':
+	    if (strcmp(optarg, "small") == 0) {
+		config.pages = Arena::SMALL;
+	    } else if (strcmp(optarg, "thp") == 0) {
+		config.pages = Arena::THP;
+	    } else if (strcmp(optarg, "hugetlb") == 0) {
+		config.pages = Arena::HUGETLB;
+	    } else {
+		fprintf(stderr, "Error: unknown page mode '%s'\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'I':
+	    if (strcmp(optarg, "aio") == 0) {
+		config.backend_kind = Backend::AIO;
+	    } else if (strcmp(optarg, "uring") == 0) {
+		config.backend_kind = Backend::URING;
+	    } else {
+		fprintf(stderr, "Error: unknown backend '%s'\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'L':
+	    config.lock = true;
+	    break;
+	case 'P':
+	    config.backend_flags |= Backend::IOPOLL;
+	    break;
+	case 'S':
+	    config.backend_flags |= Backend::SQPOLL;
 	    break;
 	case 'm':
-	    memory = atoll(optarg);
+	    config.memory = atoll(optarg);
+	    break;
+	case 'M':
+	    config.mix = atoi(optarg);
+	    break;
+	case 'q':
+	    config.rate = atof(optarg);
+	    break;
+	case 'Q':
+	    bandwidth = atof(optarg);
+	    break;
+	case 'V':
+	    config.lag = atoi(optarg);
+	    break;
+	case 'y':
+	    config.retries = atoi(optarg);
+	    break;
+	case 'O':
+	    bad_list = optarg;
+	    break;
+	case 'C':
+	    config.stall = atoi(optarg);
+	    if (config.stall < 0) {
+		fprintf(stderr, "Error: --stall can't be negative\n");
+		exit(1);
+	    }
+	    break;
+	case 'A':
+	    if (!parse_stall_action(optarg, config.stall_action)) {
+		fprintf(stderr, "Error: unknown stall action '%s'\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'o':
+	    if (!parse_order(optarg, config.order)) {
+		fprintf(stderr, "Error: unknown order '%s'\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'p':
+	    config.spin = atoi(optarg);
 	    break;
 	case 'r':
-	    requests = atoi(optarg);
+	    config.requests = atoi(optarg);
+	    break;
+	case 'R':
+	    config.seed = strtoull(optarg, nullptr, 0);
+	    break;
+	case 's':
+	    if (strcmp(optarg, "stripe") == 0) {
+		config.shard_mode = Shard::STRIPE;
+	    } else if (strcmp(optarg, "range") == 0) {
+		config.shard_mode = Shard::RANGE;
+	    } else {
+		fprintf(stderr, "Error: unknown shard mode '%s'\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 't':
+	    config.iothreads = atoi(optarg);
 	    break;
 	case 'w':
-	    num_workers = atoi(optarg);
+	    config.workers = atoi(optarg);
+	    break;
+	case 'W':
+	    worker_cpus = optarg;
+	    break;
+	case 'T':
+	    iothread_cpus = optarg;
+	    break;
+	case 'x':
+	    passes = optarg;
+	    break;
+	case 'n':
+	    config.nondestructive = true;
+	    break;
+	case 'j':
+	    journal_path = optarg;
+	    break;
+	case 'u':
+	    restore = true;
+	    break;
+	case 'G':
+	    config.regions = atoi(optarg);
+	    break;
+	case 'f':
+	    config.slow = atof(optarg);
+	    break;
+	case 'a':
+	    heatmap_path = optarg;
+	    break;
+	case 'N':
+	    config.node = atoi(optarg);
+	    break;
+	case 'X':
+	    sweep = optarg;
+	    break;
+	case 'Z':
+	    config.sweep_size = atoll(optarg);
+	    break;
+	case 'K':
+	    config.warmup = atoi(optarg);
+	    break;
+	case 'J':
+	    config.window = atoi(optarg);
+	    break;
+	case 'F':
+	    sweep_output = optarg;
 	    break;
 	case 'h':
 	    usage(argv[0]);
@@ -121,27 +1616,233 @@ int main(int argc, char * const argv []) {
 	exit(1);
     }
 
-    if (memory == 0) memory = blocksize * requests;
-    if (memory < blocksize * requests) {
-	fprintf(stderr, "Error: memory [%lx] < blocksize * requests [%lx]\n",
-		memory, blocksize * requests);
+    if (restore) {
+	if (journal_path == nullptr) {
+	    fprintf(stderr, "Error: --restore needs --journal\n");
+	    exit(1);
+	}
+	File file(name);
+	long num = Journal::restore(journal_path, file);
+	if (num < 0) exit(1);
+	printf("restored %ld blocks from %s\n", num, journal_path);
+	return 0;
+    }
+    if ((config.batch <= 0) || (config.batch > config.requests)) {
+	config.batch = config.requests;
+    }
+    if ((config.backend_flags != 0)
+	&& (config.backend_kind != Backend::URING)) {
+	fprintf(stderr, "Error: --sqpoll and --iopoll need --backend uring\n");
+	exit(1);
+    }
+    if ((config.mix < 0) || (config.mix > 99)) {
+	fprintf(stderr, "Error: --mix must be 0 - 99 %% reads\n");
+	exit(1);
+    }
+    if (passes != nullptr) {
+	if (!parse_passes(passes, config, config.passes)) {
+	    fprintf(stderr, "Error: bad list of passes '%s'\n", passes);
+	    exit(1);
+	}
+    } else if (config.nondestructive) {
+	config.passes.push_back(Pass{config.pattern, IOCB::WRITE,
+				     config.order, false, true, false});
+    } else if (config.lag >= 0) {
+	config.passes.push_back(Pass{config.pattern, IOCB::WRITE,
+				     config.order, true, false, false});
+    } else {
+	config.passes.push_back(Pass{config.pattern, IOCB::WRITE,
+				     config.order, false, false, false});
+	config.passes.push_back(Pass{config.pattern, IOCB::READ,
+				     config.order, false, false, false});
+    }
+    config.split = false;
+    config.scan_only = (config.engine == PIPELINE);
+    bool verify = false;
+    bool preserve = false;
+    for (const Pass &pass : config.passes) {
+	config.scan_only = config.scan_only && pass.scan;
+	verify = verify || pass.verify;
+	preserve = preserve || pass.preserve;
+	if ((pass.kind == IOCB::WRITE)
+	    && ((config.mix > 0) || pass.verify || pass.preserve)) {
+	    config.split = true;
+	}
+	if (config.nondestructive && (pass.kind == IOCB::WRITE)
+	    && !pass.preserve) {
+	    fprintf(stderr, "Error: --nondestructive only allows read and"
+		    " preserve passes\n");
+	    exit(1);
+	}
+    }
+    if (config.split && (config.engine != PIPELINE)) {
+	fprintf(stderr, "Error: --mix, verify and preserve passes need"
+		" --engine pipeline\n");
+	exit(1);
+    }
+    if (bandwidth > 0) config.rate = bandwidth * MEGA / config.blocksize;
+    if ((config.rate < 0) || (bandwidth < 0)) {
+	fprintf(stderr, "Error: rate can't be negative\n");
+	exit(1);
+    }
+    if ((config.rate > 0) && (config.engine != PIPELINE)) {
+	fprintf(stderr, "Error: --iops and --bandwidth need --engine"
+		" pipeline\n");
+	exit(1);
+    }
+    if (config.iothreads < 1) {
+	fprintf(stderr, "Error: need at least one iothread\n");
+	exit(1);
+    }
+    if (config.regions < 1) {
+	fprintf(stderr, "Error: need at least one region\n");
+	exit(1);
+    }
+    if (config.slow <= 1) {
+	fprintf(stderr, "Error: --slow needs a factor above 1\n");
+	exit(1);
+    }
+    if (config.retries < 0) {
+	fprintf(stderr, "Error: retries can't be negative\n");
+	exit(1);
+    }
+    // the rest is about passes
+    if (sweep != nullptr) {
+	run_sweep(argv[0], name, config, sweep, sweep_output);
+	return 0;
+    }
+    for (const Pass &pass : config.passes) {
+	if (pass.scan) continue;
+	if (config.blocksize % Generator::align(pass.pattern) != 0) {
+	    fprintf(stderr, "Error: blocksize must be a multiple of %#lx for"
+		    " pattern %s\n", Generator::align(pass.pattern),
+		    Generator::name(pass.pattern));
+	    exit(1);
+	}
+    }
+    size_t min_memory = config.blocksize * config.requests * config.iothreads;
+    if (config.memory == 0) config.memory = min_memory;
+    if (config.memory < min_memory) {
+	fprintf(stderr, "Error: memory [%lx] < blocksize * requests"
+		" * iothreads [%lx]\n", config.memory, min_memory);
+	exit(1);
+    }
+    if (preserve
+	&& (config.memory / config.blocksize / config.iothreads < 2)) {
+	fprintf(stderr, "Error: preserve passes need two buffers per"
+		" iothread\n");
 	exit(1);
     }
-
-    printf("%s V0.0\n", argv[0]);
-    printf("blocksize = %#lx\n", blocksize);
-    printf("requests  = %d\n", requests);
-    printf("memory    = %#lx\n", memory);
-    printf("workers   = %d\n", num_workers);
 
     File file(name);
-    off_t size = file.size() / blocksize * blocksize;
-    if (size < off_t(memory)) {
+    Extents extents;
+    BadBlocks bad(file, config.retries, extents);
+    Watchdog watchdog(config.stall * 1000000ULL, config.stall_action);
+    off_t size = file.size() / config.blocksize * config.blocksize;
+    if (size < off_t(config.memory)) {
 	fprintf(stderr, "Error: Too much memory [%lx] for file size [%lx]\n",
-		size, memory);
+		size, config.memory);
 	exit(1);
     }
 
+    int dev_node = device_node(file);
+    if (config.node == -2) config.node = dev_node;
+    if ((worker_cpus != nullptr)
+	&& !config.worker_cpus.parse(worker_cpus, dev_node)) {
+	fprintf(stderr, "Error: bad cpu list '%s'%s\n", worker_cpus,
+		(dev_node < 0) ? " (numa node of device unknown)" : "");
+	exit(1);
+    }
+    if ((iothread_cpus != nullptr)
+	&& !config.iothread_cpus.parse(iothread_cpus, dev_node)) {
+	fprintf(stderr, "Error: bad cpu list '%s'%s\n", iothread_cpus,
+		(dev_node < 0) ? " (numa node of device unknown)" : "");
+	exit(1);
+    }
+
+    printf("%s V0.0\n", argv[0]);
+    printf("engine    = %s\n",
+	   (config.engine == PIPELINE) ? "pipeline" : "percore");
+    printf("blocksize = %#lx\n", config.blocksize);
+    printf("requests  = %d\n", config.requests);
+    printf("batch     = %d\n", config.batch);
+    printf("backend   = %s%s%s\n", Backend::name(config.backend_kind),
+	   (config.backend_flags & Backend::SQPOLL) ? " sqpoll" : "",
+	   (config.backend_flags & Backend::IOPOLL) ? " iopoll" : "");
+    printf("poll      = %d us\n", config.spin);
+    printf("iothreads = %d (%s)\n", config.iothreads,
+	   Shard::name(config.shard_mode));
+    printf("order     = %s\n", Shard::name(config.order));
+    printf("retries   = %d per sector of %zu bytes\n", config.retries,
+	   bad.sector_size());
+    if (config.stall > 0) {
+	printf("stall     = %d ms, then %s\n", config.stall,
+	       Watchdog::name(config.stall_action));
+    } else {
+	printf("stall     = never\n");
+    }
+    if (bad_list != nullptr) {
+	printf("bad list  = %s (blocks of %#lx bytes)\n", bad_list,
+	       config.blocksize);
+    }
+    printf("slow      = %.1f times the device's p50 or p99\n", config.slow);
+    if (heatmap_path != nullptr) printf("heatmap   = %s\n", heatmap_path);
+    if (config.mix > 0) printf("mix       = %d%% reads\n", config.mix);
+    if (config.rate > 0) {
+	printf("rate      = %.0f requests/s, %.1f MiB/s\n", config.rate,
+	       config.rate * config.blocksize / MEGA);
+    }
+    if (verify) {
+	printf("verify    = %d writes behind\n", std::max(config.lag, 0));
+    }
+    if (preserve) {
+	printf("journal   = %s\n", (journal_path != nullptr) ? journal_path
+	       : "none, an interrupted run loses the blocks in flight");
+    }
+    printf("memory    = %#lx\n", config.memory);
+    // every slice handed out may be padded to Arena::ALIGN
+    size_t buffers = config.memory / config.blocksize * config.blocksize;
+    if (config.scan_only) {
+	buffers = std::min(buffers, config.iothreads * config.blocksize
+			   * Lane::SCAN_BUFFERS);
+    }
+    Arena arena(buffers + config.iothreads * Arena::ALIGN,
+		config.pages, config.lock, config.node);
+    printf("arena     = %#lx (%s%s)\n", arena.size(),
+	   Arena::name(arena.pages()), arena.locked() ? ", locked" : "");
+    printf("workers   = %d\n", config.workers);
+    printf("pattern   = %s kernel, crc32c %s, seed %#lx\n",
+	   pattern_kernel().name, crc32c_name(), config.seed);
+    printf("passes    = %zu\n", config.passes.size());
+    printf("device node   = %d\n", dev_node);
+    printf("buffer node   = %d\n", config.node);
+    printf("worker cpus   = %s\n", config.worker_cpus.str().c_str());
+    printf("iothread cpus = %s\n", config.iothread_cpus.str().c_str());
+
+    // one generator per pattern, the pass number is set per write pass
+    Generator *gens[Generator::CRC + 1] = { };
+    Journal *journal = nullptr;
+    if (preserve && (journal_path != nullptr)) {
+	journal = new Journal(journal_path, config.blocksize,
+			      config.memory / config.blocksize / 2);
+    }
+    FILE *heatmap = nullptr;
+    if (heatmap_path != nullptr) {
+	heatmap = fopen(heatmap_path, "w");
+	if (heatmap == nullptr) {
+	    fprintf(stderr, "Error: opening '%s': %s\n", heatmap_path,
+		    strerror(errno));
+	    exit(1);
+	}
+	Regions::write_header(heatmap);
+    }
+    for (const Pass &pass : config.passes) {
+	if (!pass.scan && (gens[pass.pattern] == nullptr)) {
+	    gens[pass.pattern] = Generator::create(pass.pattern, config.seed);
+	    gens[pass.pattern]->extents(&extents);
+	}
+    }
+
     static struct sigaction action;
     memset(&action, 0, sizeof(action));
     action.sa_sigaction = alarm_action;
@@ -160,197 +1861,32 @@ int main(int argc, char * const argv []) {
 	perror("setitimer");
 	assert(false);
     }
-    
-    { // write test
-	PipePair<IOCB> source = mkpipe<IOCB>();
-	PipePair<IOCB> mid = mkpipe<IOCB>();
-	PipePair<IOCB> drain = mkpipe<IOCB>();
-    
-	Workers<IOCBWorker> workers(num_workers, std::move(source.first),
-				    std::move(mid.second));
-	IOThread iothread(requests, std::move(mid.first),
-			  std::move(drain.second));
-
-	WritePipe<IOCB> in = std::move(source.second);
-	ReadPipe<IOCB> out = std::move(drain.first);
-
-	int num_iocb = memory / blocksize;
-	off_t offset = 0;
-	off_t completed = 0;
-	off_t last_completed = 0;
-	struct timeval start;
-	struct timeval last;
-	struct timeval now;
-
-	res = gettimeofday(&start, nullptr);
-	assert(res == 0);
-	last = start;
-	// fill pipe with buffers
-	for (int i = 0; i < num_iocb; ++i) {
-	    IOCB * iocb = new IOCB(file, IOCB::WRITE, blocksize);
-	    iocb->offset(offset);
-	    offset += blocksize;
-	    in.write(iocb);
-	}
-
-	print_completed = false;
-
-	// loop till end of file
-	while (offset < size) {
-	    IOCB * iocb = out.read();
-	    iocb->check();
-	    iocb->offset(offset);
-	    offset += blocksize;
-	    in.write(iocb);
-	    completed += blocksize;
-	    if (print_completed) {
-		print_completed = false;
-		res = gettimeofday(&now, nullptr);
-		assert(res == 0);
-		fprintf(stderr,
-			"%f : write completed = %lu MiB / %lu MiB [ %f MiB/s ]\n",
-			diff(start, now),
-			completed / MEGA, size / MEGA,
-			(completed - last_completed) / 1024.0 / 1024.0
-			/ diff(last, now));
-		last_completed = completed;
-		last = now;
-	    }
-	}
-	
-	// reap buffers
-	in.close();
-	while (out) {
-	    IOCB * iocb = out.read();
-	    if (iocb == nullptr) {
-		assert(!out);
-		break;
-	    }
-	    iocb->check();
-	    delete iocb;
-	    completed += blocksize;
-	    if (print_completed) {
-		print_completed = false;
-		res = gettimeofday(&now, nullptr);
-		assert(res == 0);
-		fprintf(stderr,
-			"%f : write completed = %lu MiB / %lu MiB [ %f MiB/s ]\n",
-			diff(start, now),
-			completed / MEGA, size / MEGA,
-			(completed - last_completed) / 1024.0 / 1024.0
-			/ diff(last, now));
-		last_completed = completed;
-		last = now;
-	    }
-	}
 
-	// final progress
-	if (last_completed != completed) {
-	    res = gettimeofday(&now, nullptr);
-	    assert(res == 0);
-	    fprintf(stderr,
-		    "%f : write completed = %lu MiB / %lu MiB [ %f MiB/s ]\n",
-		    diff(start, now),
-		    completed / MEGA, size / MEGA,
-		    (completed - last_completed) / 1024.0 / 1024.0
-		    / diff(last, now));
-	}
+    if (config.engine == PERCORE) {
+	run_percore(file, config, arena, gens, bad, watchdog, heatmap, size);
+    } else {
+	run_pipeline(file, config, arena, gens, journal, bad, watchdog,
+		     heatmap, size);
     }
-    
-    { // read test
-	PipePair<IOCB> source = mkpipe<IOCB>();
-	PipePair<IOCB> mid = mkpipe<IOCB>();
-	PipePair<IOCB> drain = mkpipe<IOCB>();
-    
-	IOThread iothread(requests, std::move(source.first),
-			  std::move(mid.second));
-	Workers<IOCBWorker> workers(num_workers, std::move(mid.first),
-				    std::move(drain.second));
-
-	WritePipe<IOCB> in = std::move(source.second);
-	ReadPipe<IOCB> out = std::move(drain.first);
-
-	int num_iocb = memory / blocksize;
-	off_t offset = 0;
-	off_t completed = 0;
-	off_t last_completed = 0;
-	struct timeval start;
-	struct timeval last;
-	struct timeval now;
-
-	res = gettimeofday(&start, nullptr);
-	assert(res == 0);
-	last = start;
-	// fill pipe with buffers
-	for (int i = 0; i < num_iocb; ++i) {
-	    IOCB * iocb = new IOCB(file, IOCB::READ, blocksize);
-	    iocb->offset(offset);
-	    offset += blocksize;
-	    iocb->fill();
-	    in.write(iocb);
-	}
-
-	print_completed = false;
-
-	// loop till end of file
-	while (offset < size) {
-	    IOCB * iocb = out.read();
-	    iocb->offset(offset);
-	    offset += blocksize;
-	    iocb->fill();
-	    in.write(iocb);
-	    completed += blocksize;
-	    if (print_completed) {
-		print_completed = false;
-		res = gettimeofday(&now, nullptr);
-		assert(res == 0);
-		fprintf(stderr,
-			"%f : read completed = %lu MiB / %lu MiB [ %f MiB/s ]\n",
-			diff(start, now),
-			completed / MEGA, size / MEGA,
-			(completed - last_completed) / 1024.0 / 1024.0
-			/ diff(last, now));
-		last_completed = completed;
-		last = now;
-	    }
-	}
-	
-	// reap buffers
-	in.close();
-	while (out) {
-	    IOCB * iocb = out.read();
-	    if (iocb == nullptr) {
-		assert(!out);
-		break;
-	    }
-	    delete iocb;
-	    completed += blocksize;
-	    if (print_completed) {
-		print_completed = false;
-		res = gettimeofday(&now, nullptr);
-		assert(res == 0);
-		fprintf(stderr,
-			"%f : read completed = %lu MiB / %lu MiB [ %f MiB/s ]\n",
-			diff(start, now),
-			completed / MEGA, size / MEGA,
-			(completed - last_completed) / 1024.0 / 1024.0
-			/ diff(last, now));
-		last_completed = completed;
-		last = now;
-	    }
-	}
-
-	// final progress
-	if (last_completed != completed) {
-	    res = gettimeofday(&now, nullptr);
-	    assert(res == 0);
-	    fprintf(stderr,
-		    "%f : read completed = %lu MiB / %lu MiB [ %f MiB/s ]\n",
-		    diff(start, now),
-		    completed / MEGA, size / MEGA,
-		    (completed - last_completed) / 1024.0 / 1024.0
-		    / diff(last, now));
+    if (heatmap != nullptr) {
+	bool ok = !ferror(heatmap);
+	if ((fclose(heatmap) != 0) || !ok) {
+	    fprintf(stderr, "Error: writing '%s': %s\n", heatmap_path,
+		    strerror(errno));
+	    exit(1);
 	}
     }
+    // the rest is in the list
+    extents.print(32);
+    if ((bad_list != nullptr) && !extents.write_list(bad_list,
+						     config.blocksize)) {
+	fprintf(stderr, "Error: writing '%s': %s\n", bad_list,
+		strerror(errno));
+	exit(1);
+    }
+    for (Generator *gen : gens) {
+	delete gen;
+    }
+    delete journal;
     printf("shutting down\n");
 }
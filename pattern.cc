@@ -0,0 +1,380 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* offset pattern kernels
+ */
+
+#include "pattern.h"
+#include <cstdint>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static void fill_scalar(void *buf, size_t size, off_t o) {
+    off_t *p = (off_t *)buf;
+    off_t *q = (off_t *)(uintptr_t(buf) + size);
+    while (p < q) {
+	*p = o;
+	++p;
+	o += sizeof(off_t);
+    }
+}
+
+static size_t check_scalar(const void *buf, size_t size, off_t o) {
+    const off_t *p = (const off_t *)buf;
+    size_t n = size / sizeof(off_t);
+    for (size_t i = 0; i < n; ++i) {
+	if (p[i] != o) return i;
+	o += sizeof(off_t);
+    }
+    return n;
+}
+
+enum {
+    LANES = 8,
+    SECTOR_WORDS = SECTOR / sizeof(uint64_t),
+};
+
+static const uint64_t GOLDEN = 0x9e3779b97f4a7c15ULL;
+
+// start of stream lane for key, never 0
+static inline uint64_t lane_seed(uint64_t key, int lane) {
+    return mix64(key + (lane + 1) * GOLDEN) | 1;
+}
+
+static void fill_random_scalar(void *buf, size_t sectors,
+			       const uint64_t *keys) {
+    uint64_t *p = (uint64_t *)buf;
+    for (size_t i = 0; i < sectors; ++i) {
+	uint64_t s[LANES];
+	for (int l = 0; l < LANES; ++l) s[l] = lane_seed(keys[i], l);
+	for (size_t k = 0; k < SECTOR_WORDS; k += LANES) {
+	    for (int l = 0; l < LANES; ++l) {
+		*p++ = s[l];
+		s[l] ^= s[l] << 13;
+		s[l] ^= s[l] >> 7;
+		s[l] ^= s[l] << 17;
+	    }
+	}
+    }
+}
+
+static size_t check_random_scalar(const void *buf, size_t sectors,
+				  const uint64_t *keys, int skip) {
+    const uint64_t *p = (const uint64_t *)buf;
+    uint64_t expect[SECTOR_WORDS];
+    for (size_t i = 0; i < sectors; ++i) {
+	fill_random_scalar(expect, 1, keys + i);
+	for (size_t k = skip; k < SECTOR_WORDS; ++k) {
+	    if (p[k] != expect[k]) return i * SECTOR_WORDS + k;
+	}
+	p += SECTOR_WORDS;
+    }
+    return sectors * SECTOR_WORDS;
+}
+
+/* The same with the lanes spread over vectors of the native width.
+ * Written with gcc vector extensions and inlined into functions built
+ * for each instruction set.
+ */
+typedef uint64_t V2 __attribute__((vector_size(2 * sizeof(uint64_t))));
+#if defined(__x86_64__)
+typedef uint64_t V4 __attribute__((vector_size(4 * sizeof(uint64_t))));
+typedef uint64_t V8 __attribute__((vector_size(8 * sizeof(uint64_t))));
+#endif
+
+// lane_seed() for all lanes at once
+template<class V, int N>
+static inline __attribute__((always_inline))
+void seed_lanes(V (&s)[N], uint64_t key) {
+#pragma GCC unroll 8
+    for (int c = 0; c < N; ++c) {
+	V lane;
+	for (int i = 0; i < LANES / N; ++i) lane[i] = c * (LANES / N) + i + 1;
+	V x = key + lane * GOLDEN;
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	s[c] = x | 1;
+    }
+}
+
+template<class V>
+static inline __attribute__((always_inline))
+void step_lanes(V &s) {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+}
+
+template<class V>
+static inline __attribute__((always_inline))
+void fill_random_lanes(void *buf, size_t sectors, const uint64_t *keys) {
+    enum { N = LANES * sizeof(uint64_t) / sizeof(V) };
+    char *p = (char *)buf;
+    for (size_t i = 0; i < sectors; ++i) {
+	V s[N];
+	seed_lanes(s, keys[i]);
+	for (size_t k = 0; k < SECTOR_WORDS; k += LANES) {
+	    // unrolled so s[] stays in registers
+#pragma GCC unroll 8
+	    for (int c = 0; c < N; ++c) {
+		memcpy(p, &s[c], sizeof(V));
+		p += sizeof(V);
+		step_lanes(s[c]);
+	    }
+	}
+    }
+}
+
+template<class V>
+static inline __attribute__((always_inline))
+size_t check_random_lanes(const void *buf, size_t sectors,
+			  const uint64_t *keys, int skip) {
+    enum { N = LANES * sizeof(uint64_t) / sizeof(V), W = LANES / N };
+    const char *p = (const char *)buf;
+    V first[N];
+    for (int c = 0; c < N; ++c) {
+	for (int i = 0; i < W; ++i) {
+	    first[c][i] = (c * W + i < skip) ? 0 : ~0ULL;
+	}
+    }
+    for (size_t i = 0; i < sectors; ++i) {
+	V s[N], x, acc;
+	seed_lanes(s, keys[i]);
+	acc = s[0] ^ s[0];
+	for (size_t k = 0; k < SECTOR_WORDS; k += LANES) {
+#pragma GCC unroll 8
+	    for (int c = 0; c < N; ++c) {
+		memcpy(&x, p + (k + c * W) * sizeof(uint64_t), sizeof(x));
+		acc |= (k == 0) ? ((x ^ s[c]) & first[c]) : (x ^ s[c]);
+		step_lanes(s[c]);
+	    }
+	}
+	uint64_t bad = 0;
+	for (int l = 0; l < W; ++l) bad |= acc[l];
+	if (bad != 0) {
+	    return i * SECTOR_WORDS
+		+ check_random_scalar(p, 1, keys + i, skip);
+	}
+	p += SECTOR;
+    }
+    return sectors * SECTOR_WORDS;
+}
+
+// baseline build of the vector code, sse2 on x86-64
+static void fill_random_vector(void *buf, size_t sectors,
+			       const uint64_t *keys) {
+    fill_random_lanes<V2>(buf, sectors, keys);
+}
+
+static size_t check_random_vector(const void *buf, size_t sectors,
+				  const uint64_t *keys, int skip) {
+    return check_random_lanes<V2>(buf, sectors, keys, skip);
+}
+
+#if defined(__x86_64__)
+/* The vector kernels do whole vectors and leave the tail to the
+ * scalar ones. check() xors 4 vectors with the expected pattern, ors
+ * them together and tests once; on a mismatch the scalar loop finds
+ * the word.
+ */
+
+// baseline of every x86-64 cpu
+static void fill_sse2(void *buf, size_t size, off_t o) {
+    __m128i *p = (__m128i *)buf;
+    size_t n = size / sizeof(__m128i);
+    __m128i v = _mm_set_epi64x(o + 8, o);
+    const __m128i inc = _mm_set1_epi64x(sizeof(__m128i));
+    for (size_t i = 0; i < n; ++i) {
+	_mm_storeu_si128(p + i, v);
+	v = _mm_add_epi64(v, inc);
+    }
+    size_t done = n * sizeof(__m128i);
+    fill_scalar((char *)buf + done, size - done, o + done);
+}
+
+static size_t check_sse2(const void *buf, size_t size, off_t o) {
+    const __m128i *p = (const __m128i *)buf;
+    size_t n = size / sizeof(__m128i) / 4 * 4;
+    __m128i v = _mm_set_epi64x(o + 8, o);
+    const __m128i inc = _mm_set1_epi64x(sizeof(__m128i));
+    const __m128i inc4 = _mm_set1_epi64x(4 * sizeof(__m128i));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i < n; i += 4) {
+	__m128i v1 = _mm_add_epi64(v, inc);
+	__m128i v2 = _mm_add_epi64(v1, inc);
+	__m128i v3 = _mm_add_epi64(v2, inc);
+	__m128i x = _mm_or_si128(
+	    _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(p + i), v),
+			 _mm_xor_si128(_mm_loadu_si128(p + i + 1), v1)),
+	    _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(p + i + 2), v2),
+			 _mm_xor_si128(_mm_loadu_si128(p + i + 3), v3)));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xFFFF) break;
+	v = _mm_add_epi64(v, inc4);
+    }
+    size_t done = i * sizeof(__m128i);
+    return done / sizeof(off_t)
+	+ check_scalar((const char *)buf + done, size - done, o + done);
+}
+
+__attribute__((target("avx2")))
+static void fill_avx2(void *buf, size_t size, off_t o) {
+    __m256i *p = (__m256i *)buf;
+    size_t n = size / sizeof(__m256i);
+    __m256i v = _mm256_set_epi64x(o + 24, o + 16, o + 8, o);
+    const __m256i inc = _mm256_set1_epi64x(sizeof(__m256i));
+    for (size_t i = 0; i < n; ++i) {
+	_mm256_storeu_si256(p + i, v);
+	v = _mm256_add_epi64(v, inc);
+    }
+    size_t done = n * sizeof(__m256i);
+    fill_scalar((char *)buf + done, size - done, o + done);
+}
+
+__attribute__((target("avx2")))
+static size_t check_avx2(const void *buf, size_t size, off_t o) {
+    const __m256i *p = (const __m256i *)buf;
+    size_t n = size / sizeof(__m256i) / 4 * 4;
+    __m256i v = _mm256_set_epi64x(o + 24, o + 16, o + 8, o);
+    const __m256i inc = _mm256_set1_epi64x(sizeof(__m256i));
+    const __m256i inc4 = _mm256_set1_epi64x(4 * sizeof(__m256i));
+    size_t i = 0;
+    for (; i < n; i += 4) {
+	__m256i v1 = _mm256_add_epi64(v, inc);
+	__m256i v2 = _mm256_add_epi64(v1, inc);
+	__m256i v3 = _mm256_add_epi64(v2, inc);
+	__m256i x = _mm256_or_si256(
+	    _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(p + i), v),
+			    _mm256_xor_si256(_mm256_loadu_si256(p + i + 1),
+					     v1)),
+	    _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(p + i + 2),
+					     v2),
+			    _mm256_xor_si256(_mm256_loadu_si256(p + i + 3),
+					     v3)));
+	if (!_mm256_testz_si256(x, x)) break;
+	v = _mm256_add_epi64(v, inc4);
+    }
+    size_t done = i * sizeof(__m256i);
+    return done / sizeof(off_t)
+	+ check_scalar((const char *)buf + done, size - done, o + done);
+}
+
+__attribute__((target("avx512f")))
+static void fill_avx512(void *buf, size_t size, off_t o) {
+    __m512i *p = (__m512i *)buf;
+    size_t n = size / sizeof(__m512i);
+    __m512i v = _mm512_set_epi64(o + 56, o + 48, o + 40, o + 32,
+				 o + 24, o + 16, o + 8, o);
+    const __m512i inc = _mm512_set1_epi64(sizeof(__m512i));
+    for (size_t i = 0; i < n; ++i) {
+	_mm512_storeu_si512(p + i, v);
+	v = _mm512_add_epi64(v, inc);
+    }
+    size_t done = n * sizeof(__m512i);
+    fill_scalar((char *)buf + done, size - done, o + done);
+}
+
+__attribute__((target("avx512f")))
+static size_t check_avx512(const void *buf, size_t size, off_t o) {
+    const __m512i *p = (const __m512i *)buf;
+    size_t n = size / sizeof(__m512i) / 4 * 4;
+    __m512i v = _mm512_set_epi64(o + 56, o + 48, o + 40, o + 32,
+				 o + 24, o + 16, o + 8, o);
+    const __m512i inc = _mm512_set1_epi64(sizeof(__m512i));
+    const __m512i inc4 = _mm512_set1_epi64(4 * sizeof(__m512i));
+    size_t i = 0;
+    for (; i < n; i += 4) {
+	__m512i v1 = _mm512_add_epi64(v, inc);
+	__m512i v2 = _mm512_add_epi64(v1, inc);
+	__m512i v3 = _mm512_add_epi64(v2, inc);
+	__m512i x = _mm512_or_si512(
+	    _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(p + i), v),
+			    _mm512_xor_si512(_mm512_loadu_si512(p + i + 1),
+					     v1)),
+	    _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(p + i + 2),
+					     v2),
+			    _mm512_xor_si512(_mm512_loadu_si512(p + i + 3),
+					     v3)));
+	if (_mm512_test_epi64_mask(x, x) != 0) break;
+	v = _mm512_add_epi64(v, inc4);
+    }
+    size_t done = i * sizeof(__m512i);
+    return done / sizeof(off_t)
+	+ check_scalar((const char *)buf + done, size - done, o + done);
+}
+
+__attribute__((target("avx2")))
+static void fill_random_avx2(void *buf, size_t sectors,
+			     const uint64_t *keys) {
+    fill_random_lanes<V4>(buf, sectors, keys);
+}
+
+__attribute__((target("avx2")))
+static size_t check_random_avx2(const void *buf, size_t sectors,
+				const uint64_t *keys, int skip) {
+    return check_random_lanes<V4>(buf, sectors, keys, skip);
+}
+
+__attribute__((target("avx512f")))
+static void fill_random_avx512(void *buf, size_t sectors,
+			       const uint64_t *keys) {
+    fill_random_lanes<V8>(buf, sectors, keys);
+}
+
+__attribute__((target("avx512f")))
+static size_t check_random_avx512(const void *buf, size_t sectors,
+				  const uint64_t *keys, int skip) {
+    return check_random_lanes<V8>(buf, sectors, keys, skip);
+}
+#endif // #if defined(__x86_64__)
+
+static std::vector<PatternKernel> supported() {
+    std::vector<PatternKernel> kernels;
+    kernels.push_back({ "scalar", fill_scalar, check_scalar,
+			fill_random_scalar, check_random_scalar });
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    kernels.push_back({ "sse2", fill_sse2, check_sse2,
+			fill_random_vector, check_random_vector });
+    if (__builtin_cpu_supports("avx2")) {
+	kernels.push_back({ "avx2", fill_avx2, check_avx2,
+			    fill_random_avx2, check_random_avx2 });
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+	kernels.push_back({ "avx512", fill_avx512, check_avx512,
+			    fill_random_avx512, check_random_avx512 });
+    }
+#else
+    kernels.push_back({ "vector", fill_scalar, check_scalar,
+			fill_random_vector, check_random_vector });
+#endif
+    return kernels;
+}
+
+const std::vector<PatternKernel> & pattern_kernels() {
+    static const std::vector<PatternKernel> kernels = supported();
+    return kernels;
+}
+
+const PatternKernel & pattern_kernel() {
+    static const PatternKernel &best = pattern_kernels().back();
+    return best;
+}
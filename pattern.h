@@ -0,0 +1,69 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* offset pattern kernels
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H 1
+
+#include <sys/types.h>
+#include <cstdint>
+#include <vector>
+
+/* Offset pattern: every 8 byte word of a block holds its own offset
+ * on the device.
+ *
+ * Random pattern: every SECTOR bytes are generated from a 64 bit key
+ * by 8 interleaved xorshift64 streams, word i coming from stream i % 8.
+ * The streams are what makes it vectorize.
+ *
+ * Kernels fill and verify the patterns in the widest vectors the cpu
+ * has, picked at runtime.
+ */
+static const size_t SECTOR = 512;
+
+struct PatternKernel {
+    const char *name;
+    // stamp size bytes at buf, the first word gets offset
+    void (*fill)(void *buf, size_t size, off_t offset);
+    // index of the first word not matching, size / 8 if all do
+    size_t (*check)(const void *buf, size_t size, off_t offset);
+    // random data for sectors from keys[0 .. sectors - 1]
+    void (*fill_random)(void *buf, size_t sectors, const uint64_t *keys);
+    /* index of the first word not matching, sectors * SECTOR / 8 if all
+     * do; the first skip (<= 8) words of each sector are ignored
+     */
+    size_t (*check_random)(const void *buf, size_t sectors,
+			   const uint64_t *keys, int skip);
+};
+
+// splitmix64 finalizer, spreads similar inputs over all bits
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// all kernels the cpu supports, slowest first
+const std::vector<PatternKernel> & pattern_kernels();
+// the fastest of them
+const PatternKernel & pattern_kernel();
+
+#endif // #ifndef PATTERN_H
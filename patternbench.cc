@@ -0,0 +1,226 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* speed of the pattern kernels and generators on one core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cassert>
+#include "pattern.h"
+#include "generator.h"
+#include "crc32c.h"
+#include "clock.h"
+
+enum {
+    ALIGN = 4096,
+    RUN_NS = 500 * 1000 * 1000,
+};
+
+// every kernel must agree with the scalar one, also on mismatches
+static bool sane(const PatternKernel &kernel, off_t *buf, size_t size) {
+    const PatternKernel &scalar = pattern_kernels().front();
+    size_t n = size / sizeof(off_t);
+    off_t start = 0x123456000;
+    kernel.fill(buf, size, start);
+    if (scalar.check(buf, size, start) != n) return false;
+    size_t pos[] = { 0, 1, 7, 8, 31, 32, n / 2, n - 1 };
+    for (size_t i : pos) {
+	if (i >= n) continue;
+	buf[i] ^= 1UL << (i % 64);
+	bool ok = kernel.check(buf, size, start) == i;
+	buf[i] ^= 1UL << (i % 64);
+	if (!ok) return false;
+    }
+    // odd sizes exercise the scalar tail
+    for (size_t len = sizeof(off_t); len < 1024; len += sizeof(off_t)) {
+	if (kernel.check(buf, len, start) != len / sizeof(off_t)) return false;
+    }
+
+    size_t sectors = size / SECTOR;
+    uint64_t keys[sectors];
+    for (size_t j = 0; j < sectors; ++j) keys[j] = start + j * SECTOR;
+    kernel.fill_random(buf, sectors, keys);
+    if (scalar.check_random(buf, sectors, keys, 0) != n) return false;
+    for (size_t i : pos) {
+	if (i >= n) continue;
+	buf[i] ^= 1UL << (i % 64);
+	bool ok = kernel.check_random(buf, sectors, keys, 0) == i;
+	// skipped words don't count
+	size_t skip = kernel.check_random(buf, sectors, keys, 5);
+	ok = ok && (skip == ((i % (SECTOR / sizeof(off_t)) < 5) ? n : i));
+	buf[i] ^= 1UL << (i % 64);
+	if (!ok) return false;
+    }
+    return true;
+}
+
+// generators must tell what went wrong
+static bool classify(Generator::Kind kind) {
+    Generator *gen = Generator::create(kind, 0x1234);
+    off_t a = 0x10000, b = 0x20000;
+    uint64_t block[2][SECTOR / sizeof(uint64_t)];
+    uint64_t other[2][SECTOR / sizeof(uint64_t)];
+    bool ok = true;
+
+    // silence the error reports
+    fflush(stderr);
+    int saved = dup(2);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 2);
+
+    gen->fill(block, sizeof(block), a);
+    gen->check(block, sizeof(block), a);
+    Generator::Errors e = gen->errors();
+    ok = ok && (e.corrupt + e.misdirected + e.stale + e.torn == 0);
+
+    block[1][10] ^= 1;
+    gen->check(block, sizeof(block), a);
+    e = gen->errors();
+    ok = ok && (e.corrupt == 1);
+    block[1][10] ^= 1;
+
+    if ((kind == Generator::OFFSET) || (kind == Generator::HEADER)
+	|| (kind == Generator::CRC)) {
+	gen->check(block, sizeof(block), b);
+	e = gen->errors();
+	ok = ok && (e.misdirected == 2);
+    }
+    if ((kind == Generator::HEADER) || (kind == Generator::CRC)) {
+	gen->pass(1);
+	gen->check(block, sizeof(block), a);
+	e = gen->errors();
+	ok = ok && (e.stale == 2) && (e.torn == 0);
+
+	gen->fill(other, sizeof(other), a);
+	memcpy(block[1], other[1], SECTOR);
+	gen->check(block, sizeof(block), a);
+	e = gen->errors();
+	ok = ok && (e.stale == 1) && (e.torn == 1);
+
+    }
+    if (kind == Generator::HEADER) {
+	// same run and pass, different writes
+	gen->fill(block, sizeof(block), a);
+	memcpy(block[1], other[1], SECTOR);
+	gen->check(block, sizeof(block), a);
+	e = gen->errors();
+	ok = ok && (e.stale == 0) && (e.torn == 1);
+    }
+
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+    close(null);
+    delete gen;
+    return ok;
+}
+
+template<class Fn>
+static double gbps(size_t size, Fn fn) {
+    uint64_t start = now_ns();
+    uint64_t bytes = 0;
+    uint64_t now;
+    do {
+	fn();
+	bytes += size;
+	now = now_ns();
+    } while (now - start < RUN_NS);
+    return double(bytes) / (now - start);
+}
+
+int main(int argc, char * const argv[]) {
+    size_t size = 1024 * 1024;
+    if (argc > 1) size = atoll(argv[1]);
+    if ((argc > 2) || (size == 0) || (size % SECTOR != 0)) {
+	fprintf(stderr, "Usage: %s [buffer size in sectors of 512 byte,"
+		" default 1MiB]\n", argv[0]);
+	exit(1);
+    }
+
+    size_t len = (size + ALIGN - 1) / ALIGN * ALIGN;
+    off_t *buf = (off_t *)aligned_alloc(ALIGN, len);
+    assert(buf != nullptr);
+    memset(buf, 0, size);
+    size_t sectors = size / SECTOR;
+    uint64_t *keys = new uint64_t[sectors];
+    for (size_t j = 0; j < sectors; ++j) keys[j] = j * SECTOR;
+
+    printf("buffer = %#lx, best = %s, crc32c = %s\n", size,
+	   pattern_kernel().name, crc32c_name());
+    if (crc32c("123456789", 9) != 0xe3069283) {
+	printf("crc32c FAILED self check\n");
+    }
+    printf("%-8s %10s %10s %10s %10s  [GB/s]\n", "kernel",
+	   "offset fill", "check", "random fill", "check");
+    for (const PatternKernel &kernel : pattern_kernels()) {
+	if (!sane(kernel, buf, size)) {
+	    printf("%-8s FAILED self check\n", kernel.name);
+	    continue;
+	}
+	off_t o = 0;
+	double fill = gbps(size, [&]() {
+		kernel.fill(buf, size, o);
+	    });
+	kernel.fill(buf, size, o);
+	size_t words = 0;
+	double check = gbps(size, [&]() {
+		words += kernel.check(buf, size, o);
+	    });
+	assert(words % (size / sizeof(off_t)) == 0);
+	double rfill = gbps(size, [&]() {
+		kernel.fill_random(buf, sectors, keys);
+	    });
+	double rcheck = gbps(size, [&]() {
+		words += kernel.check_random(buf, sectors, keys, 0);
+	    });
+	assert(words % (size / sizeof(off_t)) == 0);
+	printf("%-8s %11.2f %10.2f %11.2f %10.2f\n", kernel.name, fill, check,
+	       rfill, rcheck);
+    }
+
+    uint32_t *crc = new uint32_t[sectors];
+    printf("\ncrc32c %.2f GB/s\n", gbps(size, [&]() {
+		crc32c_blocks(buf, sectors, SECTOR, SECTOR, crc);
+	    }));
+    delete[] crc;
+    printf("\n%-10s %10s %10s  [GB/s]\n", "pattern", "fill", "check");
+    Generator::Kind kinds[] = { Generator::OFFSET, Generator::RANDOM,
+				Generator::BADBLOCKS, Generator::HEADER,
+				Generator::CRC };
+    for (Generator::Kind kind : kinds) {
+	if (!classify(kind)) {
+	    printf("%-10s FAILED self check\n", Generator::name(kind));
+	    continue;
+	}
+	Generator *gen = Generator::create(kind, 0x1234);
+	double fill = gbps(size, [&]() {
+		gen->fill(buf, size, 0);
+	    });
+	double check = gbps(size, [&]() {
+		gen->check(buf, size, 0);
+	    });
+	Generator::Errors e = gen->errors();
+	assert(e.corrupt + e.misdirected + e.stale + e.torn == 0);
+	printf("%-10s %10.2f %10.2f\n", Generator::name(kind), fill, check);
+	delete gen;
+    }
+    delete[] keys;
+    free(buf);
+}
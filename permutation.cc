@@ -0,0 +1,51 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* seeded bijection on [0, size)
+ */
+
+#include "permutation.h"
+#include <cassert>
+#include "pattern.h"
+
+Permutation::Permutation(uint64_t size, uint64_t seed)
+    : size_(size), half_(1) {
+    // both halves get half_ bits, together they cover size
+    while ((half_ < 32) && ((1ULL << (2 * half_)) < size_)) ++half_;
+    mask_ = (1ULL << half_) - 1;
+    for (int r = 0; r < ROUNDS; ++r) {
+	keys_[r] = mix64(seed + r * 0x9e3779b97f4a7c15ULL);
+    }
+}
+
+uint64_t Permutation::encrypt(uint64_t x) const {
+    uint64_t l = x >> half_;
+    uint64_t r = x & mask_;
+    for (int i = 0; i < ROUNDS; ++i) {
+	uint64_t t = l ^ (mix64(r ^ keys_[i]) & mask_);
+	l = r;
+	r = t;
+    }
+    return (l << half_) | r;
+}
+
+uint64_t Permutation::operator()(uint64_t n) const {
+    assert(n < size_);
+    do {
+	n = encrypt(n);
+    } while (n >= size_);
+    return n;
+}
@@ -0,0 +1,50 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* seeded bijection on [0, size)
+ */
+
+#ifndef PERMUTATION_H
+#define PERMUTATION_H 1
+
+#include <cstdint>
+
+/* Shuffles the numbers 0 .. size - 1 without any table: a Feistel
+ * network permutes the next power of 4 and values outside the range
+ * are fed through again (cycle walking) till they fall inside. That
+ * takes at most 4 rounds on average. The same seed gives the same
+ * order.
+ */
+class Permutation {
+public:
+    Permutation(uint64_t size, uint64_t seed);
+
+    uint64_t size() const { return size_; }
+    uint64_t operator()(uint64_t n) const;
+private:
+    enum {
+	ROUNDS = 6,
+    };
+
+    uint64_t encrypt(uint64_t x) const;
+
+    uint64_t size_;
+    int half_;
+    uint64_t mask_;
+    uint64_t keys_[ROUNDS];
+};
+
+#endif // #ifndef PERMUTATION_H
@@ -16,6 +16,10 @@
 */
 
 /* wrappers around pipes
+ *
+ * Nothing hands IOCBs through pipes any more, ReadRing/WriteRing in
+ * ring.h took over with the same interface and their read_batch(),
+ * try_read_batch() and write_batch() are the batched hand-off.
  */
 
 #ifndef PIPE_H
@@ -0,0 +1,188 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* latency by position on the device
+ */
+
+#include "regions.h"
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+Regions::Regions(off_t size, size_t unit)
+    : end_(size), size_(0), num_(0), region_(nullptr) {
+    assert(unit > 0);
+    off_t u = unit;
+    off_t min = (size + MAX - 1) / MAX;
+    size_ = std::max((min + u - 1) / u * u, u);
+    num_ = std::max((size + size_ - 1) / size_, off_t(1));
+    // zeroed
+    region_ = new Region[num_]();
+}
+
+Regions::~Regions() {
+    delete[] region_;
+}
+
+uint64_t Regions::ops() const {
+    uint64_t ops = 0;
+    for (size_t i = 0; i < num_; ++i) {
+	ops += region_[i].ops.load(std::memory_order_relaxed);
+    }
+    return ops;
+}
+
+void Regions::print(const char *phase, const char *dir, size_t num) const {
+    assert(num > 0);
+    // regions per line
+    size_t group = (num_ + num - 1) / num;
+    for (size_t i = 0; i < num_; i += group) {
+	uint64_t ops = 0;
+	uint64_t sum = 0;
+	uint64_t max = 0;
+	for (size_t j = i; j < std::min(i + group, num_); ++j) {
+	    const Region &region = region_[j];
+	    ops += region.ops.load(std::memory_order_relaxed);
+	    sum += region.sum.load(std::memory_order_relaxed);
+	    max = std::max(max, region.max.load(std::memory_order_relaxed));
+	}
+	off_t end = std::min(off_t(i + group) * size_, end_);
+	printf("%s: region %#lx - %#lx: %lu %ss, latency avg %.1f us,"
+	       " max %.1f us\n", phase, off_t(i) * size_, end, ops, dir,
+	       sum / 1000.0 / std::max(ops, uint64_t(1)), max / 1000.0);
+    }
+}
+
+void Regions::print_slow(const char *phase, const char *dir,
+			 double factor, size_t max) const {
+    Summary device = this->device();
+    if (device.ops == 0) return;
+    std::vector<size_t> found;
+    for (size_t i = 0; i < num_; ++i) {
+	if (slow(summary(i), device, factor)) found.push_back(i);
+    }
+    printf("%s: %zu of %zu regions of %#lx bytes are %.1f times slower"
+	   " than the device's %s p50 %.1f us or p99 %.1f us\n", phase,
+	   found.size(), num_, size_, factor, dir, device.p50 / 1000.0,
+	   device.p99 / 1000.0);
+    for (size_t n = 0; n < std::min(found.size(), max); ++n) {
+	size_t i = found[n];
+	Summary region = summary(i);
+	off_t end = std::min(off_t(i + 1) * size_, end_);
+	printf("%s: slow region %#lx - %#lx: %lu %ss, p50 %.1f us,"
+	       " p99 %.1f us\n", phase, off_t(i) * size_, end, region.ops,
+	       dir, region.p50 / 1000.0, region.p99 / 1000.0);
+    }
+    if (found.size() > max) {
+	printf("%s: %zu more slow regions\n", phase, found.size() - max);
+    }
+}
+
+void Regions::write_header(FILE *file) {
+    fprintf(file, "pass,phase,dir,offset,size,ops,mib_s,avg_us,p50_us,"
+	    "p99_us,max_us,slow\n");
+}
+
+void Regions::write(FILE *file, size_t pass, const char *phase,
+		    const char *dir, double factor) const {
+    Summary device = this->device();
+    if (device.ops == 0) return;
+    for (size_t i = 0; i < num_; ++i) {
+	const Region &region = region_[i];
+	Summary summary = this->summary(i);
+	uint64_t bytes = region.bytes.load(std::memory_order_relaxed);
+	uint64_t first = region.first.load(std::memory_order_relaxed);
+	uint64_t last = region.last.load(std::memory_order_relaxed);
+	// from the first submit to the last completion, sequential passes
+	double mibs = (last > first)
+	    ? bytes / 1024.0 / 1024.0 / ((last - first) / 1e9) : 0;
+	fprintf(file, "%zu,%s,%s,%ld,%ld,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%d\n",
+		pass, phase, dir, off_t(i) * size_,
+		std::min(size_, end_ - off_t(i) * size_), summary.ops, mibs,
+		region.sum.load(std::memory_order_relaxed) / 1000.0
+		/ std::max(summary.ops, uint64_t(1)),
+		summary.p50 / 1000.0, summary.p99 / 1000.0,
+		region.max.load(std::memory_order_relaxed) / 1000.0,
+		slow(summary, device, factor));
+    }
+}
+
+uint64_t Regions::top(unsigned bin) {
+    uint64_t us;
+    if (bin < SUB) {
+	us = bin;
+    } else {
+	unsigned shift = bin / SUB - 1;
+	uint64_t low = uint64_t(bin - shift * SUB) << shift;
+	us = low + (uint64_t(1) << shift) - 1;
+    }
+    return (us << 10) + 1023;
+}
+
+uint64_t Regions::percentile(const uint64_t bins[], uint64_t total,
+			     double fraction) {
+    uint64_t want = std::max(uint64_t(std::ceil(fraction * total)),
+			     uint64_t(1));
+    uint64_t seen = 0;
+    for (int i = 0; i < BINS; ++i) {
+	seen += bins[i];
+	if (seen >= want) return top(i);
+    }
+    return top(BINS - 1);
+}
+
+Regions::Summary Regions::summary(size_t i) const {
+    const Region &region = region_[i];
+    uint64_t bins[BINS];
+    uint64_t total = 0;
+    for (int j = 0; j < BINS; ++j) {
+	bins[j] = region.bins[j].load(std::memory_order_relaxed);
+	total += bins[j];
+    }
+    uint64_t max = region.max.load(std::memory_order_relaxed);
+    Summary summary;
+    summary.ops = total;
+    summary.p50 = std::min(percentile(bins, total, 0.5), max);
+    summary.p99 = std::min(percentile(bins, total, 0.99), max);
+    return summary;
+}
+
+Regions::Summary Regions::device() const {
+    uint64_t bins[BINS] = { };
+    uint64_t total = 0;
+    uint64_t max = 0;
+    for (size_t i = 0; i < num_; ++i) {
+	const Region &region = region_[i];
+	for (int j = 0; j < BINS; ++j) {
+	    uint64_t n = region.bins[j].load(std::memory_order_relaxed);
+	    bins[j] += n;
+	    total += n;
+	}
+	max = std::max(max, region.max.load(std::memory_order_relaxed));
+    }
+    Summary summary;
+    summary.ops = total;
+    summary.p50 = std::min(percentile(bins, total, 0.5), max);
+    summary.p99 = std::min(percentile(bins, total, 0.99), max);
+    return summary;
+}
+
+bool Regions::slow(const Summary &region, const Summary &device,
+		   double factor) {
+    if (region.ops == 0) return false;
+    return (region.p50 > factor * device.p50)
+	|| ((region.ops >= TAIL_OPS) && (region.p99 > factor * device.p99));
+}
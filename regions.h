@@ -0,0 +1,144 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* latency by position on the device
+ */
+
+#ifndef REGIONS_H
+#define REGIONS_H 1
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+/* Latency and throughput of the requests by where on the device they
+ * went, in at most MAX regions so memory does not grow with the
+ * device. add() is lock-free, any number of threads can share one
+ * Regions. Each region keeps a coarse histogram with SUB buckets per
+ * power of two of us, like Histogram but small enough to keep
+ * thousands of. That is plenty to compare the regions with each other
+ * and find the slow ones, which often go bad long before they fail.
+ */
+class Regions {
+public:
+    enum {
+	MAX = 4096,
+	BITS = 2,
+	SUB = 1 << BITS,
+	// 1 us to 2^TOP us (4.5 minutes), anything longer in the last
+	TOP = 28,
+	BINS = (TOP + 1 - BITS) * SUB,
+	// fewer requests make p99 little more than the max
+	TAIL_OPS = 100,
+    };
+
+    // [0, size) in regions of a multiple of unit bytes
+    Regions(off_t size, size_t unit);
+    ~Regions();
+
+    // bytes at offset, submitted at start and completed at end (in ns)
+    void add(off_t offset, uint64_t start, uint64_t end, size_t bytes) {
+	Region &region = region_[offset / size_];
+	region.ops.fetch_add(1, std::memory_order_relaxed);
+	region.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	region.sum.fetch_add(end - start, std::memory_order_relaxed);
+	region.bins[bin(end - start)].fetch_add(1, std::memory_order_relaxed);
+	raise(region.max, end - start);
+	raise(region.last, end);
+	lower(region.first, start);
+    }
+
+    uint64_t ops() const;
+
+    // num equal parts of the device, one line each
+    void print(const char *phase, const char *dir, size_t num) const;
+
+    /* the first max regions whose p50 is over factor times the p50 of
+     * the whole device or, with TAIL_OPS requests or more, whose p99 is
+     * over factor times its p99
+     */
+    void print_slow(const char *phase, const char *dir, double factor,
+		    size_t max) const;
+
+    static void write_header(FILE *file);
+    // one csv line per region, slow ones flagged
+    void write(FILE *file, size_t pass, const char *phase, const char *dir,
+	       double factor) const;
+private:
+    Regions(Regions &&) = delete;
+    Regions & operator =(Regions &&) = delete;
+
+    struct Region {
+	std::atomic<uint64_t> ops;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+	// first submit and last completion, 0 if none
+	std::atomic<uint64_t> first;
+	std::atomic<uint64_t> last;
+	std::atomic<uint32_t> bins[BINS];
+    };
+
+    // what is needed to tell if a region is slow
+    struct Summary {
+	uint64_t ops;
+	uint64_t p50;
+	uint64_t p99;
+    };
+
+    static unsigned bin(uint64_t ns) {
+	// close enough to us
+	uint64_t us = std::min(ns >> 10, (uint64_t(1) << TOP) - 1);
+	if (us < SUB) return us;
+	unsigned shift = 63 - __builtin_clzll(us) - BITS;
+	return shift * SUB + (us >> shift);
+    }
+
+    // largest ns in bin
+    static uint64_t top(unsigned bin);
+    static uint64_t percentile(const uint64_t bins[], uint64_t total,
+			       double fraction);
+
+    static void raise(std::atomic<uint64_t> &a, uint64_t v) {
+	uint64_t cur = a.load(std::memory_order_relaxed);
+	while ((cur < v)
+	       && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+	}
+    }
+
+    static void lower(std::atomic<uint64_t> &a, uint64_t v) {
+	uint64_t cur = a.load(std::memory_order_relaxed);
+	while (((cur == 0) || (v < cur))
+	       && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+	}
+    }
+
+    Summary summary(size_t i) const;
+    // of all regions together
+    Summary device() const;
+    static bool slow(const Summary &region, const Summary &device,
+		     double factor);
+
+    off_t end_;
+    // bytes per region
+    off_t size_;
+    size_t num_;
+    Region *region_;
+};
+
+#endif // #ifndef REGIONS_H
@@ -0,0 +1,406 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* lock-free ring buffer between threads
+ *
+ * Drop-in replacement for ReadPipe/WritePipe: pointers are passed
+ * through a bounded MPMC ring in shared memory and threads only enter
+ * the kernel (eventfd) when they have to sleep on an empty or full
+ * ring. Like pipes the ends can be dup()ed and the reading side sees
+ * EOF once all writing ends are closed and the ring is drained.
+ */
+
+#ifndef RING_H
+#define RING_H 1
+
+#include <sys/eventfd.h>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+#include <cstdint>
+#include "eventfd.h"
+
+template<class T> class ReadRing;
+template<class T> class WriteRing;
+
+template<class T>
+using RingPair = std::pair<ReadRing<T>, WriteRing<T> >;
+
+template<class T> RingPair<T> mkring(size_t size);
+
+/* Sleep / wakeup for one condition of the ring. Sleepers register
+ * before re-checking the condition so a waker either sees them or they
+ * see the change.
+ */
+class RingWaiter {
+public:
+    RingWaiter() : e_(EFD_SEMAPHORE), sleepers_(0) { }
+
+    int fd() const { return e_.fd(); }
+
+    template<class Ready>
+    void wait(Ready ready) {
+	while (!ready()) {
+	    if (!sleep_begin(ready)) return;
+	    e_.read();
+	    sleepers_.fetch_sub(1);
+	}
+    }
+
+    // register as sleeper, returns false if ready() became true
+    template<class Ready>
+    bool sleep_begin(Ready ready) {
+	sleepers_.fetch_add(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (ready()) {
+	    sleepers_.fetch_sub(1);
+	    return false;
+	}
+	return true;
+    }
+
+    // unregister, consume the wakeup if fd() was seen readable
+    void sleep_end(bool woken) {
+	if (woken) e_.read();
+	sleepers_.fetch_sub(1);
+    }
+
+    void wake(uint64_t num = 1) {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int sleepers = sleepers_.load(std::memory_order_relaxed);
+	if ((num > 0) && (sleepers > 0)) {
+	    e_.write(std::min(num, uint64_t(sleepers)));
+	}
+    }
+
+    // wake everyone, now and in the future
+    void wake_all() {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	e_.write(UINT32_MAX);
+    }
+private:
+    RingWaiter(RingWaiter &&) = delete;
+    RingWaiter & operator =(RingWaiter &&) = delete;
+
+    EventFD e_;
+    std::atomic<int> sleepers_;
+};
+
+template<class T>
+class Ring {
+public:
+    Ring(size_t size)
+	: cell_(new Cell[size]), mask_(size - 1),
+	  head_(0), tail_(0), writers_(1), closed_(false) {
+	assert((size & mask_) == 0);
+	for (size_t i = 0; i < size; ++i) {
+	    cell_[i].seq.store(i, std::memory_order_relaxed);
+	}
+    }
+
+    ~Ring() {
+	delete[] cell_;
+    }
+
+    bool push(T * t) {
+	size_t pos = tail_.load(std::memory_order_relaxed);
+	while (true) {
+	    Cell & cell = cell_[pos & mask_];
+	    size_t seq = cell.seq.load(std::memory_order_acquire);
+	    intptr_t dif = intptr_t(seq) - intptr_t(pos);
+	    if (dif == 0) {
+		if (tail_.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed)) {
+		    cell.data = t;
+		    cell.seq.store(pos + 1, std::memory_order_release);
+		    return true;
+		}
+	    } else if (dif < 0) {
+		return false; // full
+	    } else {
+		pos = tail_.load(std::memory_order_relaxed);
+	    }
+	}
+    }
+
+    bool pop(T * &t) {
+	size_t pos = head_.load(std::memory_order_relaxed);
+	while (true) {
+	    Cell & cell = cell_[pos & mask_];
+	    size_t seq = cell.seq.load(std::memory_order_acquire);
+	    intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+	    if (dif == 0) {
+		if (head_.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed)) {
+		    t = cell.data;
+		    cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+		    return true;
+		}
+	    } else if (dif < 0) {
+		return false; // empty
+	    } else {
+		pos = head_.load(std::memory_order_relaxed);
+	    }
+	}
+    }
+
+    bool empty() const {
+	size_t pos = head_.load(std::memory_order_relaxed);
+	size_t seq = cell_[pos & mask_].seq.load(std::memory_order_acquire);
+	return intptr_t(seq) - intptr_t(pos + 1) < 0;
+    }
+
+    bool closed() const {
+	return closed_.load(std::memory_order_acquire);
+    }
+
+    void add_writer() {
+	writers_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void close_writer() {
+	if (writers_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+	    closed_.store(true, std::memory_order_release);
+	    not_empty_.wake_all();
+	}
+    }
+
+    RingWaiter not_empty_;
+    RingWaiter not_full_;
+private:
+    Ring(Ring &&) = delete;
+    Ring & operator =(Ring &&) = delete;
+
+    struct Cell {
+	std::atomic<size_t> seq;
+	T * data;
+    };
+
+    enum { CACHELINE = 64 };
+
+    Cell * cell_;
+    size_t mask_;
+    char pad0_[CACHELINE];
+    std::atomic<size_t> head_;
+    char pad1_[CACHELINE];
+    std::atomic<size_t> tail_;
+    char pad2_[CACHELINE];
+    std::atomic<int> writers_;
+    std::atomic<bool> closed_;
+};
+
+template<class T>
+class ReadRing {
+public:
+    // closed end
+    ReadRing() { }
+
+    ReadRing(ReadRing && other) : ring_(std::move(other.ring_)) { }
+
+    ReadRing & operator = (ReadRing && other) {
+	assert(!ring_);
+	ring_ = std::move(other.ring_);
+	return *this;
+    }
+
+    ~ReadRing(void) { }
+
+    void close() {
+	assert(ring_);
+	ring_.reset();
+    }
+
+    int fd(void) const { return ring_->not_empty_.fd(); }
+    operator bool() const { return bool(ring_); }
+
+    // blocks till data is available, returns nullptr on EOF
+    T * read(void) {
+	assert(ring_);
+	T * res = nullptr;
+	Ring<T> & ring = *ring_;
+	ring.not_empty_.wait([&]() {
+		return ring.pop(res) || ring.closed();
+	    });
+	if (res == nullptr) res = eof();
+	if (res != nullptr) ring.not_full_.wake();
+	return res;
+    }
+
+    // returns nullptr if nothing is available or on EOF
+    T * try_read(void) {
+	assert(ring_);
+	T * res = nullptr;
+	if (ring_->pop(res)) {
+	    ring_->not_full_.wake();
+	    return res;
+	}
+	if (ring_->closed()) return eof();
+	return nullptr;
+    }
+
+    /* blocks till data is available, then reads up to max pointers,
+     * returns 0 on EOF
+     */
+    size_t read_batch(T ** out, size_t max) {
+	assert(ring_);
+	assert(max > 0);
+	bool got = false;
+	Ring<T> & ring = *ring_;
+	ring.not_empty_.wait([&]() {
+		got = ring.pop(out[0]);
+		return got || ring.closed();
+	    });
+	if (!got && !ring.pop(out[0])) {
+	    close();
+	    return 0;
+	}
+	size_t num = 1 + drain(out + 1, max - 1);
+	ring.not_full_.wake(num);
+	return num;
+    }
+
+    // reads up to max pointers, returns 0 if nothing is available or on EOF
+    size_t try_read_batch(T ** out, size_t max) {
+	assert(ring_);
+	size_t num = drain(out, max);
+	if (num > 0) {
+	    ring_->not_full_.wake(num);
+	    return num;
+	}
+	if (ring_->closed()) {
+	    num = drain(out, max);
+	    if (num == 0) close();
+	}
+	return num;
+    }
+
+    /* Sleep on fd() in select() together with other fds:
+     *     if (ring.sleep_begin()) {
+     *         select(...);
+     *         ring.sleep_end(FD_ISSET(ring.fd(), &set));
+     *     }
+     * Only valid with a single reader.
+     */
+    bool sleep_begin(void) {
+	Ring<T> & ring = *ring_;
+	return ring.not_empty_.sleep_begin([&]() {
+		return !ring.empty() || ring.closed();
+	    });
+    }
+
+    void sleep_end(bool woken) {
+	ring_->not_empty_.sleep_end(woken);
+    }
+
+    ReadRing dup(void) const {
+	assert(ring_);
+	return ReadRing(ring_);
+    }
+private:
+    ReadRing(std::shared_ptr<Ring<T> > ring) : ring_(std::move(ring)) { }
+
+    size_t drain(T ** out, size_t max) {
+	size_t num = 0;
+	while ((num < max) && ring_->pop(out[num])) ++num;
+	return num;
+    }
+
+    // all writers are gone, drain what is left or close
+    T * eof(void) {
+	T * res = nullptr;
+	if (ring_->pop(res)) return res;
+	close();
+	return nullptr;
+    }
+
+    std::shared_ptr<Ring<T> > ring_;
+
+    friend RingPair<T> mkring<T>(size_t size);
+};
+
+template<class T>
+class WriteRing {
+public:
+    // closed end
+    WriteRing() { }
+
+    WriteRing(WriteRing && other) : ring_(std::move(other.ring_)) { }
+
+    WriteRing & operator = (WriteRing && other) {
+	assert(!ring_);
+	ring_ = std::move(other.ring_);
+	return *this;
+    }
+
+    ~WriteRing(void) {
+	if (ring_) close();
+    }
+
+    void close() {
+	assert(ring_);
+	ring_->close_writer();
+	ring_.reset();
+    }
+
+    operator bool() const { return bool(ring_); }
+
+    void write(T * t) {
+	assert(ring_);
+	Ring<T> & ring = *ring_;
+	ring.not_full_.wait([&]() { return ring.push(t); });
+	ring.not_empty_.wake();
+    }
+
+    void write_batch(T * const * in, size_t num) {
+	assert(ring_);
+	Ring<T> & ring = *ring_;
+	size_t woken = 0;
+	for (size_t i = 0; i < num; ++i) {
+	    if (!ring.push(in[i])) {
+		// full, let readers have what we have so far
+		ring.not_empty_.wake(i - woken);
+		woken = i;
+		ring.not_full_.wait([&]() { return ring.push(in[i]); });
+	    }
+	}
+	ring.not_empty_.wake(num - woken);
+    }
+
+    WriteRing dup(void) const {
+	assert(ring_);
+	ring_->add_writer();
+	return WriteRing(ring_);
+    }
+private:
+    WriteRing(std::shared_ptr<Ring<T> > ring) : ring_(std::move(ring)) { }
+
+    std::shared_ptr<Ring<T> > ring_;
+
+    friend RingPair<T> mkring<T>(size_t size);
+};
+
+template<class T>
+RingPair<T> mkring(size_t size) {
+    size_t n = 2;
+    while (n < size) n *= 2;
+    std::shared_ptr<Ring<T> > ring(new Ring<T>(n));
+    return std::make_pair(ReadRing<T>(ring), WriteRing<T>(ring));
+}
+
+#endif // #ifndef RING_H
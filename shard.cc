@@ -0,0 +1,80 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* split the device into per thread slices
+ */
+
+#include "shard.h"
+#include <cassert>
+
+// number of blocks in shard index of num
+static uint64_t count(Shard::Mode mode, int index, int num, uint64_t total) {
+    switch (mode) {
+    case Shard::STRIPE:
+	return (uint64_t(index) < total) ? (total - index + num - 1) / num : 0;
+    case Shard::RANGE:
+	return total * (index + 1) / num - total * index / num;
+    }
+    assert(false);
+    return 0;
+}
+
+Shard::Shard(Mode mode, int index, int num, off_t size, size_t blocksize,
+	     Order order, uint64_t seed)
+    : mode_(mode), order_(order), num_(num), blocksize_(blocksize),
+      first_(0), blocks_(count(mode, index, num, size / blocksize)),
+      perm_(blocks_, seed + index) {
+    assert((index >= 0) && (index < num));
+    uint64_t total = size / blocksize;
+    switch (mode_) {
+    case STRIPE:
+	first_ = index;
+	break;
+    case RANGE:
+	first_ = total * index / num;
+	break;
+    }
+}
+
+const char * Shard::name(Mode mode) {
+    switch (mode) {
+    case STRIPE: return "stripe";
+    case RANGE: return "range";
+    }
+    assert(false);
+    return nullptr;
+}
+
+const char * Shard::name(Order order) {
+    switch (order) {
+    case SEQUENTIAL: return "sequential";
+    case RANDOM: return "random";
+    }
+    assert(false);
+    return nullptr;
+}
+
+off_t Shard::offset(uint64_t n) const {
+    assert(n < blocks_);
+    if (order_ == RANDOM) n = perm_(n);
+    switch (mode_) {
+    case STRIPE: return (first_ + n * num_) * blocksize_;
+    case RANGE: return (first_ + n) * blocksize_;
+    }
+    assert(false);
+    return -1;
+}
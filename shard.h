@@ -0,0 +1,61 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* split the device into per thread slices
+ */
+
+#ifndef SHARD_H
+#define SHARD_H 1
+
+#include <sys/types.h>
+#include <cstdint>
+#include "permutation.h"
+
+class Shard {
+public:
+    enum Mode {
+	STRIPE, // every num-th block
+	RANGE,  // one contiguous range
+    };
+
+    enum Order {
+	SEQUENTIAL,
+	RANDOM, // every block once, shuffled by seed
+    };
+
+    Shard(Mode mode, int index, int num, off_t size, size_t blocksize,
+	  Order order = SEQUENTIAL, uint64_t seed = 0);
+
+    static const char * name(Mode mode);
+    static const char * name(Order order);
+
+    // number of blocks in this shard
+    uint64_t blocks() const { return blocks_; }
+
+    // offset of the n-th block of this shard
+    off_t offset(uint64_t n) const;
+private:
+    Mode mode_;
+    Order order_;
+    int num_;
+    size_t blocksize_;
+    uint64_t first_;
+    uint64_t blocks_;
+    Permutation perm_;
+};
+
+#endif // #ifndef SHARD_H
@@ -0,0 +1,206 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* queue depth and block size sweep
+ */
+
+#include "sweep.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "backend.h"
+#include "file.h"
+#include "badblocks.h"
+#include "clock.h"
+#include "latency.h"
+
+enum {
+    CHUNK = 1 << 30,	// largest buffer a backend registers
+};
+
+Sweep::Sweep(File &file, Backend *backend, BadBlocks &bad,
+	     Watchdog &watchdog, IOCB::Kind kind, char *buf, size_t bufsize,
+	     off_t size, Shard::Order order, uint64_t seed, uint64_t warmup,
+	     uint64_t window)
+    : file_(file), backend_(backend), bad_(bad),
+      inflight_(watchdog, backend), kind_(kind), buf_(buf),
+      size_(size), order_(order), seed_(seed), warmup_(warmup),
+      window_(window), chunk_(CHUNK) {
+    backend_->register_file(file.fd());
+    for (size_t off = 0; off < bufsize; off += chunk_) {
+	chunks_.push_back(new IOCB(file, kind, nullptr, buf + off,
+				   std::min(chunk_, bufsize - off)));
+    }
+    backend_->register_buffers(chunks_);
+}
+
+Sweep::~Sweep() {
+    for (IOCB * iocb : chunks_) delete iocb;
+    delete backend_;
+}
+
+void Sweep::run(const std::vector<int> &depths,
+		const std::vector<size_t> &sizes) {
+    for (size_t blocksize : sizes) {
+	size_t first = cells_.size();
+	for (int depth : depths) {
+	    Cell cell = Cell();
+	    cell.blocksize = blocksize;
+	    cell.depth = depth;
+	    measure(cell);
+	    fprintf(stderr, "sweep: blocksize %zu depth %d: %.1f MiB/s\n",
+		    blocksize, depth, cell.mibs());
+	    cells_.push_back(cell);
+	}
+	knee(first, depths.size());
+    }
+}
+
+void Sweep::print() const {
+    printf("sweep: %9s %5s %10s %9s %9s %9s %9s %9s %9s\n", "blocksize",
+	   "depth", "IOPS", "MiB/s", "avg us", "p50 us", "p99 us",
+	   "p99.9 us", "max us");
+    for (const Cell &cell : cells_) {
+	printf("sweep: %9zu %5d %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f%s\n",
+	       cell.blocksize, cell.depth, cell.iops(), cell.mibs(),
+	       cell.avg / 1000.0, cell.p50 / 1000.0, cell.p99 / 1000.0,
+	       cell.p999 / 1000.0, cell.max / 1000.0,
+	       cell.knee ? " knee" : "");
+    }
+}
+
+bool Sweep::write(const char *path) const {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) return false;
+    size_t len = strlen(path);
+    bool json = (len >= 5) && (strcmp(path + len - 5, ".json") == 0);
+    if (json) {
+	fprintf(file, "[\n");
+    } else {
+	fprintf(file, "blocksize,depth,iops,mib_s,avg_us,p50_us,p99_us,"
+		"p999_us,max_us,knee\n");
+    }
+    for (size_t i = 0; i < cells_.size(); ++i) {
+	const Cell &cell = cells_[i];
+	if (json) {
+	    fprintf(file, "  {\"blocksize\": %zu, \"depth\": %d,"
+		    " \"iops\": %.0f, \"mib_s\": %.1f, \"avg_us\": %.1f,"
+		    " \"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f,"
+		    " \"max_us\": %.1f, \"knee\": %s}%s\n",
+		    cell.blocksize, cell.depth, cell.iops(), cell.mibs(),
+		    cell.avg / 1000.0, cell.p50 / 1000.0, cell.p99 / 1000.0,
+		    cell.p999 / 1000.0, cell.max / 1000.0,
+		    cell.knee ? "true" : "false",
+		    (i + 1 < cells_.size()) ? "," : "");
+	} else {
+	    fprintf(file, "%zu,%d,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%d\n",
+		    cell.blocksize, cell.depth, cell.iops(), cell.mibs(),
+		    cell.avg / 1000.0, cell.p50 / 1000.0, cell.p99 / 1000.0,
+		    cell.p999 / 1000.0, cell.max / 1000.0, cell.knee);
+	}
+    }
+    if (json) fprintf(file, "]\n");
+    bool ok = !ferror(file);
+    return (fclose(file) == 0) && ok;
+}
+
+// keep depth requests in flight, count what completes in the window
+void Sweep::measure(Cell &cell) {
+    size_t blocksize = cell.blocksize;
+    Shard shard(Shard::STRIPE, 0, 1, size_, blocksize, order_, seed_);
+    std::vector<IOCB *> free;
+    for (int i = 0; i < cell.depth; ++i) {
+	char *buf = buf_ + i * blocksize;
+	IOCB * iocb = new IOCB(file_, kind_, nullptr, buf, blocksize);
+	// odd block sizes can straddle two registered chunks, not fixed
+	size_t first = (buf - buf_) / chunk_;
+	size_t last = (buf + blocksize - 1 - buf_) / chunk_;
+	iocb->buf_index((first == last) ? chunks_[first]->buf_index() : -1);
+	free.push_back(iocb);
+    }
+
+    IOCB * iocbs[cell.depth];
+    Latency latency;
+    Histogram histogram;
+    uint64_t next = 0;
+    int pending = 0;
+    uint64_t begin = now_ns() + warmup_;
+    uint64_t end = begin + window_;
+    while (true) {
+	// refill till the window closes, then drain
+	int num = 0;
+	if (now_ns() < end) {
+	    while (!free.empty()) {
+		IOCB * iocb = free.back();
+		free.pop_back();
+		iocb->offset(shard.offset(next++ % shard.blocks()));
+		iocb->fill();
+		iocbs[num++] = iocb;
+	    }
+	}
+	if (num > 0) {
+	    uint64_t now = now_ns();
+	    for (int i = 0; i < num; ++i) {
+		iocbs[i]->started(now);
+		inflight_.add(iocbs[i]);
+	    }
+	    backend_->submit(num, iocbs);
+	    pending += num;
+	}
+	if (pending == 0) break;
+
+	int res = backend_->getevents(backend_->polled() ? 0 : 1, pending,
+				      iocbs, inflight_.check(now_ns()));
+	pending -= res;
+	uint64_t now = now_ns();
+	for (int i = 0; i < res; ++i) {
+	    IOCB * iocb = iocbs[i];
+	    iocb->finished(now);
+	    inflight_.remove(iocb);
+	    if (iocb->result() != long(blocksize)) bad_.retry(iocb);
+	    if ((now >= begin) && (now < end)) {
+		latency.add(iocb->latency(), blocksize);
+		histogram.add(iocb->latency());
+	    }
+	    iocb->check();
+	    free.push_back(iocb);
+	}
+    }
+    for (IOCB * iocb : free) delete iocb;
+
+    cell.ops = latency.ops();
+    cell.seconds = window_ / 1e9;
+    cell.avg = latency.avg();
+    cell.p50 = histogram.percentile(0.5);
+    cell.p99 = histogram.percentile(0.99);
+    cell.p999 = histogram.percentile(0.999);
+    cell.max = latency.max();
+}
+
+void Sweep::knee(size_t first, size_t num) {
+    size_t knee = first + num - 1;
+    for (size_t i = first + 1; i < first + num; ++i) {
+	const Cell &a = cells_[i - 1];
+	const Cell &b = cells_[i];
+	if ((a.ops == 0) || (b.ops == 0)) continue;
+	if (double(b.avg) / a.avg > b.iops() / a.iops()) {
+	    knee = i - 1;
+	    break;
+	}
+    }
+    cells_[knee].knee = true;
+}
@@ -0,0 +1,105 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* queue depth and block size sweep
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H 1
+
+#include <sys/types.h>
+#include <vector>
+#include <cstdint>
+#include "iocb.h"
+#include "shard.h"
+#include "watchdog.h"
+
+class File;
+class Backend;
+class BadBlocks;
+
+/* Throughput and latency for every queue depth and block size of a
+ * grid, one cell after the other on the first size bytes of the device.
+ * All cells share one backend and the buffers at buf, which must hold
+ * the largest depth times the largest block size. Each cell runs for
+ * warmup ns before completions count for a window of window ns. No
+ * pattern is written or checked, writes destroy the data.
+ *
+ * For each block size the knee is the last depth before latency grows
+ * faster than throughput, going deeper only adds queueing.
+ */
+class Sweep {
+public:
+    struct Cell {
+	size_t blocksize;
+	int depth;
+	uint64_t ops;
+	double seconds;
+	// latency in ns
+	uint64_t avg;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+	bool knee;
+
+	double iops() const { return ops / seconds; }
+	double mibs() const { return iops() * blocksize / 1024 / 1024; }
+    };
+
+    // takes ownership of backend
+    Sweep(File &file, Backend *backend, BadBlocks &bad, Watchdog &watchdog,
+	  IOCB::Kind kind, char *buf, size_t bufsize, off_t size,
+	  Shard::Order order, uint64_t seed, uint64_t warmup,
+	  uint64_t window);
+    ~Sweep();
+
+    // measures all depths for each block size, depths ascending
+    void run(const std::vector<int> &depths,
+	     const std::vector<size_t> &sizes);
+
+    // one line per cell, knees marked
+    void print() const;
+
+    // the cells as csv, or json if path ends in .json, false on error
+    bool write(const char *path) const;
+private:
+    Sweep(Sweep &&) = delete;
+    Sweep & operator =(Sweep &&) = delete;
+
+    void measure(Cell &cell);
+    // mark the knee among the cells of one block size
+    void knee(size_t first, size_t num);
+
+    File &file_;
+    Backend *backend_;
+    BadBlocks &bad_;
+    InFlight inflight_;
+    IOCB::Kind kind_;
+    char *buf_;
+    off_t size_;
+    Shard::Order order_;
+    uint64_t seed_;
+    uint64_t warmup_;
+    uint64_t window_;
+    // cover buf, only there to find the registered buffer index
+    std::vector<IOCB *> chunks_;
+    size_t chunk_;
+    std::vector<Cell> cells_;
+};
+
+#endif // #ifndef SWEEP_H
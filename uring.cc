@@ -0,0 +1,349 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* io_uring backend
+ *
+ * Talks to the kernel directly through the io_uring syscalls and the
+ * mmap()ed submission and completion rings.
+ */
+
+#include "uring.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <cassert>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include "iocb.h"
+
+enum {
+    // how long the SQPOLL kernel thread spins before it sleeps (ms)
+    SQ_THREAD_IDLE = 1000,
+};
+
+template<class T>
+static inline T load_acquire(T *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template<class T>
+static inline void store_release(T *p, T v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void * map(int fd, size_t size, off_t offset) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (p == MAP_FAILED) {
+	perror(__PRETTY_FUNCTION__);
+	assert(false);
+    }
+    return p;
+}
+
+URing::URing(int max_events, int flags)
+    : Backend(max_events), flags_(flags), fd_(-1), file_(-1),
+      fixed_bufs_(false), ext_arg_(false) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if (flags_ & SQPOLL) {
+	p.flags |= IORING_SETUP_SQPOLL;
+	p.sq_thread_idle = SQ_THREAD_IDLE;
+    }
+    if (flags_ & IOPOLL) p.flags |= IORING_SETUP_IOPOLL;
+    fd_ = syscall(__NR_io_uring_setup, max_events, &p);
+    if (fd_ < 0) {
+	fprintf(stderr, "%s: io_uring_setup(): %s\n",
+		__PRETTY_FUNCTION__, strerror(errno));
+	assert(false);
+    }
+
+    ext_arg_ = p.features & IORING_FEAT_EXT_ARG;
+
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (cq_ring_size_ > sq_ring_size_) sq_ring_size_ = cq_ring_size_;
+	sq_ring_ = map(fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+	cq_ring_ = sq_ring_;
+	cq_ring_size_ = 0;
+    } else {
+	sq_ring_ = map(fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+	cq_ring_ = map(fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+    }
+    sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = (struct io_uring_sqe *)map(fd_, sqes_size_, IORING_OFF_SQES);
+
+    char *sq = (char *)sq_ring_;
+    sq_head_ = (unsigned *)(sq + p.sq_off.head);
+    sq_tail_ = (unsigned *)(sq + p.sq_off.tail);
+    sq_flags_ = (unsigned *)(sq + p.sq_off.flags);
+    sq_array_ = (unsigned *)(sq + p.sq_off.array);
+    sq_mask_ = *(unsigned *)(sq + p.sq_off.ring_mask);
+    sq_entries_ = p.sq_entries;
+    char *cq = (char *)cq_ring_;
+    cq_head_ = (unsigned *)(cq + p.cq_off.head);
+    cq_tail_ = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask_ = *(unsigned *)(cq + p.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+}
+
+URing::~URing() {
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_size_ != 0) munmap(cq_ring_, cq_ring_size_);
+    munmap(sq_ring_, sq_ring_size_);
+    int res = close(fd_);
+    if (res != 0) {
+	perror(__PRETTY_FUNCTION__);
+	assert(false);
+    }
+}
+
+bool URing::register_iovec(const struct iovec *iov, int nr) {
+    int res = syscall(__NR_io_uring_register, fd_,
+		      IORING_REGISTER_BUFFERS, iov, nr);
+    if (res < 0) {
+	fprintf(stderr, "%s: can't register %d buffers: %s\n",
+		__PRETTY_FUNCTION__, nr, strerror(errno));
+	return false;
+    }
+    fixed_bufs_ = true;
+    return true;
+}
+
+void URing::register_file(int fd) {
+    assert(file_ == -1);
+    int res = syscall(__NR_io_uring_register, fd_,
+		      IORING_REGISTER_FILES, &fd, 1);
+    if (res < 0) {
+	fprintf(stderr, "%s: can't register file: %s\n",
+		__PRETTY_FUNCTION__, strerror(errno));
+	return;
+    }
+    file_ = fd;
+}
+
+void URing::set_eventfd(int efd) {
+    int res = syscall(__NR_io_uring_register, fd_,
+		      IORING_REGISTER_EVENTFD, &efd, 1);
+    if (res < 0) {
+	fprintf(stderr, "%s: io_uring_register(): %s\n",
+		__PRETTY_FUNCTION__, strerror(errno));
+	assert(false);
+    }
+}
+
+int URing::enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    while (true) {
+	int res = syscall(__NR_io_uring_enter, fd_, to_submit, min_complete,
+			  flags, nullptr, 0);
+	if (res < 0) {
+	    if (errno == EINTR) continue;
+	    fprintf(stderr, "%s: io_uring_enter(): %s\n",
+		    __PRETTY_FUNCTION__, strerror(errno));
+	    assert(false);
+	}
+	return res;
+    }
+}
+
+// wait for min_complete completions, false if timeout ns passed first
+bool URing::wait(unsigned min_complete, uint64_t timeout) {
+    if (timeout == 0) {
+	enter(0, min_complete, IORING_ENTER_GETEVENTS);
+	return true;
+    }
+    if (!ext_arg_) return wait_timeout(min_complete, timeout);
+    struct __kernel_timespec ts = {
+	int64_t(timeout / 1000000000), int64_t(timeout % 1000000000)
+    };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = uintptr_t(&ts);
+    int res = syscall(__NR_io_uring_enter, fd_, 0, min_complete,
+		      IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		      &arg, sizeof(arg));
+    if (res < 0) {
+	// a signal ends the wait early too, the caller waits again
+	if ((errno == ETIME) || (errno == EINTR)) return false;
+	fprintf(stderr, "%s: io_uring_enter(): %s\n",
+		__PRETTY_FUNCTION__, strerror(errno));
+	assert(false);
+    }
+    return true;
+}
+
+/* wait() for kernels before 5.11: a timeout request wakes the waiter
+ * when it fires and is removed again if the completions came first
+ */
+bool URing::wait_timeout(unsigned min_complete, uint64_t timeout) {
+    if (polled()) {
+	// polling rings take no timeouts, poll once and let the caller loop
+	enter(0, 0, IORING_ENTER_GETEVENTS);
+	return false;
+    }
+    struct __kernel_timespec ts = {
+	int64_t(timeout / 1000000000), int64_t(timeout % 1000000000)
+    };
+    unsigned tail = *sq_tail_;
+    struct io_uring_sqe *sqe = this->sqe(tail);
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    // read by the kernel when it takes the request
+    sqe->addr = uintptr_t(&ts);
+    sqe->len = 1;
+    sqe->user_data = TIMEOUT;
+    store_release(sq_tail_, tail + 1);
+    start(1);
+    enter(0, min_complete, IORING_ENTER_GETEVENTS);
+
+    // reap() drops the timeout's completion
+    unsigned head = *cq_head_;
+    unsigned end = load_acquire(cq_tail_);
+    for (; head != end; ++head) {
+	struct io_uring_cqe *cqe = &cqes_[head & cq_mask_];
+	if ((cqe->user_data == TIMEOUT) && (cqe->res == -ETIME)) {
+	    return false;
+	}
+    }
+    tail = *sq_tail_;
+    sqe = this->sqe(tail);
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = TIMEOUT;
+    sqe->user_data = TIMEOUT;
+    store_release(sq_tail_, tail + 1);
+    start(1);
+    return true;
+}
+
+// the submission queue entry for tail, zeroed
+struct io_uring_sqe * URing::sqe(unsigned tail) {
+    // only with SQPOLL the kernel can lag behind
+    while (tail - load_acquire(sq_head_) >= sq_entries_) {
+	enter(0, 0, IORING_ENTER_SQ_WAIT);
+    }
+    unsigned index = tail & sq_mask_;
+    sq_array_[index] = index;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void URing::submit(int nr, IOCB *iocbs[]) {
+    unsigned tail = *sq_tail_;
+    for (int i = 0; i < nr; ++i) {
+	IOCB * iocb = iocbs[i];
+	struct iocb *p = iocb->iocb();
+	struct io_uring_sqe *sqe = this->sqe(tail);
+	bool fixed = fixed_bufs_ && (iocb->buf_index() != -1);
+	if (p->aio_lio_opcode == IO_CMD_PREAD) {
+	    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	} else {
+	    assert(p->aio_lio_opcode == IO_CMD_PWRITE);
+	    sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	}
+	if (p->aio_fildes == file_) {
+	    sqe->fd = 0;
+	    sqe->flags = IOSQE_FIXED_FILE;
+	} else {
+	    sqe->fd = p->aio_fildes;
+	}
+	sqe->addr = uintptr_t(p->u.c.buf);
+	sqe->len = p->u.c.nbytes;
+	sqe->off = p->u.c.offset;
+	if (fixed) sqe->buf_index = iocb->buf_index();
+	sqe->user_data = uintptr_t(iocb);
+	++tail;
+    }
+    store_release(sq_tail_, tail);
+    start(nr);
+}
+
+bool URing::cancel(IOCB *iocb) {
+    unsigned tail = *sq_tail_;
+    struct io_uring_sqe *sqe = this->sqe(tail);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = uintptr_t(iocb);
+    sqe->user_data = CANCEL;
+    store_release(sq_tail_, tail + 1);
+    start(1);
+    return true;
+}
+
+// let the kernel know about the nr entries just queued
+void URing::start(int nr) {
+    if (flags_ & SQPOLL) {
+	// the tail store must be visible before we look at the flags
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (load_acquire(sq_flags_) & IORING_SQ_NEED_WAKEUP) {
+	    enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+	}
+	return;
+    }
+    int done = 0;
+    while (done < nr) {
+	int res = enter(nr - done, 0, 0);
+	done += res;
+	if (done != nr) {
+	    fprintf(stderr, "%s: io_uring_enter() was short: %d < %d\n",
+		    __PRETTY_FUNCTION__, done, nr);
+	}
+    }
+}
+
+// take what is in the completion ring
+int URing::reap(int nr, IOCB *iocbs[]) {
+    unsigned head = *cq_head_;
+    unsigned tail = load_acquire(cq_tail_);
+    int num = 0;
+    while ((head != tail) && (num < nr)) {
+	struct io_uring_cqe *cqe = &cqes_[head & cq_mask_];
+	++head;
+	if (cqe->user_data == CANCEL) {
+	    // -EALREADY: it is being cancelled
+	    if ((cqe->res < 0) && (cqe->res != -EALREADY)) {
+		fprintf(stderr, "Cancel failed: %s\n", strerror(-cqe->res));
+	    }
+	    continue;
+	}
+	if (cqe->user_data == TIMEOUT) continue;
+	IOCB * iocb = (IOCB *)uintptr_t(cqe->user_data);
+	iocb->result(cqe->res);
+	iocbs[num++] = iocb;
+    }
+    store_release(cq_head_, head);
+    return num;
+}
+
+int URing::getevents(int min_nr, int nr, IOCB *iocbs[], uint64_t timeout) {
+    int num = reap(nr, iocbs);
+    // with IOPOLL nothing completes unless we poll at least once
+    bool tried = (num > 0) || !polled();
+    while ((num < min_nr) || !tried) {
+	bool done = wait(std::max(min_nr - num, 0), timeout);
+	tried = true;
+	num += reap(nr - num, &iocbs[num]);
+	if (!done) break;
+    }
+    return num;
+}
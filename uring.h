@@ -0,0 +1,83 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/* io_uring backend
+ */
+
+#ifndef URING_H
+#define URING_H 1
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+#include "backend.h"
+
+class URing : public Backend {
+public:
+    URing(int max_events, int flags);
+    ~URing();
+    void register_file(int fd);
+    void set_eventfd(int efd);
+    void submit(int nr, IOCB *iocbs[]);
+    int getevents(int min_nr, int nr, IOCB *iocbs[], uint64_t timeout);
+    bool cancel(IOCB *iocb);
+    bool polled() const { return flags_ & IOPOLL; }
+protected:
+    bool register_iovec(const struct iovec *iov, int nr);
+private:
+    enum {
+	// user_data of cancel requests, their completion is dropped
+	CANCEL = 0,
+	// same for timeouts ending a wait, see wait()
+	TIMEOUT = 1,
+    };
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+    bool wait(unsigned min_complete, uint64_t timeout);
+    bool wait_timeout(unsigned min_complete, uint64_t timeout);
+    struct io_uring_sqe * sqe(unsigned tail);
+    void start(int nr);
+    int reap(int nr, IOCB *iocbs[]);
+
+    int flags_;
+    int fd_;
+    // fd registered as fixed file 0
+    int file_;
+    bool fixed_bufs_;
+    // the kernel takes a timeout for waits
+    bool ext_arg_;
+
+    void *sq_ring_;
+    size_t sq_ring_size_;
+    void *cq_ring_;
+    size_t cq_ring_size_;
+    struct io_uring_sqe *sqes_;
+    size_t sqes_size_;
+
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned *sq_flags_;
+    unsigned *sq_array_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned cq_mask_;
+    struct io_uring_cqe *cqes_;
+};
+
+#endif // #ifndef URING_H
@@ -0,0 +1,124 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* requests that take too long
+ */
+
+#include "watchdog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "backend.h"
+#include "iocb.h"
+
+const char * Watchdog::name(Action action) {
+    switch (action) {
+    case REPORT: return "report";
+    case CANCEL: return "cancel";
+    case ABORT: return "abort";
+    }
+    assert(false);
+    return nullptr;
+}
+
+Watchdog::Counts Watchdog::counts() const {
+    Counts counts;
+    counts.stalls = stalls_.load(std::memory_order_relaxed);
+    counts.stuck = stuck_.load(std::memory_order_relaxed);
+    counts.cancelled = cancelled_.load(std::memory_order_relaxed);
+    return counts;
+}
+
+InFlight::InFlight(Watchdog &watchdog, Backend *backend)
+    : watchdog_(watchdog), backend_(backend), oldest_(nullptr),
+      newest_(nullptr), checked_(0), deadline_(UINT64_MAX) { }
+
+void InFlight::add(IOCB *iocb) {
+    if (watchdog_.stall() == 0) return;
+    iocb->older_ = newest_;
+    iocb->newer_ = nullptr;
+    if (newest_ != nullptr) {
+	newest_->newer_ = iocb;
+    } else {
+	oldest_ = iocb;
+    }
+    newest_ = iocb;
+    // anything already in flight is due first
+    if (deadline_ == UINT64_MAX) {
+	deadline_ = iocb->started() + watchdog_.stall();
+    }
+}
+
+void InFlight::remove(IOCB *iocb) {
+    if (watchdog_.stall() == 0) return;
+    if (iocb->older_ != nullptr) {
+	iocb->older_->newer_ = iocb->newer_;
+    } else {
+	oldest_ = iocb->newer_;
+    }
+    if (iocb->newer_ != nullptr) {
+	iocb->newer_->older_ = iocb->older_;
+    } else {
+	newest_ = iocb->older_;
+    }
+    // deadline_ may now be early, the next check moves it on
+    if (stuck(iocb)) {
+	watchdog_.stuck_.fetch_sub(1, std::memory_order_relaxed);
+	if (iocb->result() == -ECANCELED) {
+	    watchdog_.cancelled_.fetch_add(1, std::memory_order_relaxed);
+	}
+	fprintf(stderr, "Stuck %s at %#lx completed after %.3f s\n",
+		(iocb->kind() == IOCB::READ) ? "read" : "write",
+		iocb->offset(), iocb->latency() / 1e9);
+    } else if (iocb->latency() >= watchdog_.stall()) {
+	watchdog_.stalls_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// reported by an earlier check
+bool InFlight::stuck(const IOCB *iocb) const {
+    return iocb->started() + watchdog_.stall() <= checked_;
+}
+
+uint64_t InFlight::expire(uint64_t now) {
+    uint64_t stall = watchdog_.stall();
+    IOCB *iocb = oldest_;
+    while ((iocb != nullptr) && stuck(iocb)) iocb = iocb->newer_;
+    deadline_ = UINT64_MAX;
+    for (; iocb != nullptr; iocb = iocb->newer_) {
+	if (iocb->started() + stall > now) {
+	    deadline_ = iocb->started() + stall;
+	    break;
+	}
+	const char *op = (iocb->kind() == IOCB::READ) ? "read" : "write";
+	double age = (now - iocb->started()) / 1e9;
+	if (watchdog_.action() == Watchdog::ABORT) {
+	    fprintf(stderr, "Error: %s of %zu bytes at %#lx stuck for %.3f s,"
+		    " giving up\n", op, iocb->size(), iocb->offset(), age);
+	    exit(1);
+	}
+	fprintf(stderr, "Stuck %s of %zu bytes at %#lx, in flight for"
+		" %.3f s\n", op, iocb->size(), iocb->offset(), age);
+	watchdog_.stalls_.fetch_add(1, std::memory_order_relaxed);
+	watchdog_.stuck_.fetch_add(1, std::memory_order_relaxed);
+	if ((watchdog_.action() == Watchdog::CANCEL)
+	    && !backend_->cancel(iocb)) {
+	    fprintf(stderr, "Can't cancel %s at %#lx\n", op, iocb->offset());
+	}
+    }
+    checked_ = now;
+    return (deadline_ == UINT64_MAX) ? 0 : deadline_ - now;
+}
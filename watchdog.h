@@ -0,0 +1,118 @@
+/* Copyright (C) 2015 Goswin von Brederlow <goswin-v-b@web.de>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* requests that take too long
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H 1
+
+#include <atomic>
+#include <cstdint>
+
+class Backend;
+class IOCB;
+
+/* A device that stops completing requests would otherwise hang the
+ * test silently. Every thread driving a backend keeps its requests in
+ * flight in an InFlight and checks them whenever it would sleep and
+ * after each batch of completions. A request still in flight stall ns
+ * after it was submitted is stuck: it is reported with its offset, age
+ * and direction and, depending on the action, cancelled or the test is
+ * aborted. Requests that took that long are counted as stalls even if
+ * they complete in the end, so firmware hiccups show up too.
+ *
+ * The counters are shared by all threads, the lists are not.
+ */
+class Watchdog {
+public:
+    enum Action {
+	REPORT,
+	CANCEL,		// ask the backend to give up on the request
+	ABORT,		// exit, the device is hung
+    };
+
+    // stall 0 disables the watchdog
+    Watchdog(uint64_t stall, Action action)
+	: stall_(stall), action_(action), stalls_(0), stuck_(0),
+	  cancelled_(0) { }
+
+    static const char * name(Action action);
+
+    uint64_t stall() const { return stall_; }
+    Action action() const { return action_; }
+
+    struct Counts {
+	uint64_t stalls;	// requests that took stall ns or longer
+	uint64_t stuck;		// of those, still in flight
+	uint64_t cancelled;	// stuck ones that came back cancelled
+    };
+
+    // since the start, subtract an earlier call for a period
+    Counts counts() const;
+private:
+    Watchdog(Watchdog &&) = delete;
+    Watchdog & operator =(Watchdog &&) = delete;
+
+    friend class InFlight;
+
+    uint64_t stall_;
+    Action action_;
+    std::atomic<uint64_t> stalls_;
+    std::atomic<uint64_t> stuck_;
+    std::atomic<uint64_t> cancelled_;
+};
+
+/* The requests one thread has in flight, linked through the IOCBs
+ * oldest first. Requests are added in submit order so the oldest one
+ * decides when the next check is due, which makes add(), remove() and
+ * a check with nothing to do O(1).
+ */
+class InFlight {
+public:
+    InFlight(Watchdog &watchdog, Backend *backend);
+
+    // after IOCB::started()
+    void add(IOCB *iocb);
+    // after IOCB::finished()
+    void remove(IOCB *iocb);
+
+    /* report requests that became stuck since the last check, returns
+     * ns till the next one would or 0 if none will
+     */
+    uint64_t check(uint64_t now) {
+	if (deadline_ == UINT64_MAX) return 0;
+	if (now < deadline_) return deadline_ - now;
+	return expire(now);
+    }
+private:
+    InFlight(InFlight &&) = delete;
+    InFlight & operator =(InFlight &&) = delete;
+
+    uint64_t expire(uint64_t now);
+    bool stuck(const IOCB *iocb) const;
+
+    Watchdog &watchdog_;
+    Backend *backend_;
+    IOCB *oldest_;
+    IOCB *newest_;
+    // time of the last expire(), what was stuck then has been reported
+    uint64_t checked_;
+    // no check needed before this, UINT64_MAX if nothing is in flight
+    uint64_t deadline_;
+};
+
+#endif // #ifndef WATCHDOG_H
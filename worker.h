@@ -23,14 +23,14 @@
 
 #include <thread>
 #include <vector>
-#include "pipe.h"
+#include "ring.h"
 
 template<class READ, class WRITE>
 class Worker {
 public:
     using Read = READ;
     using Write = WRITE;
-    Worker(ReadPipe<Read> in, WritePipe<Write> out)
+    Worker(ReadRing<Read> in, WriteRing<Write> out)
 	: in_(std::move(in)), out_(std::move(out)),
 	  thread_(&Worker::run, this) { }
 
@@ -42,23 +42,34 @@ public:
 	return thread_.get_id();
     }
 
+    std::thread & thread(void) {
+	return thread_;
+    }
+
     virtual Write * work(Read * input) = 0;
 private:
     Worker(Worker &&) = delete;
     Worker & operator =(Worker &&) = delete;
 
+    // pointers moved per ring access
+    enum { BATCH = 16 };
+
     void run(void) {
+	Read * input[BATCH];
+	Write * output[BATCH];
 	while (true) {
-	    Read * input = in_.read();
-	    if (!in_) break;
-	    Write * output = work(input);
-	    out_.write(output);
+	    size_t num = in_.read_batch(input, BATCH);
+	    if (num == 0) break;
+	    for (size_t i = 0; i < num; ++i) {
+		output[i] = work(input[i]);
+	    }
+	    out_.write_batch(output, num);
 	}
 	out_.close();
     }
 
-    ReadPipe<Read> in_;
-    WritePipe<Write> out_;
+    ReadRing<Read> in_;
+    WriteRing<Write> out_;
     std::thread thread_;
 };
 
@@ -68,13 +79,21 @@ public:
     using Read = typename W::Read;
     using Write = typename W::Write;
 
-    Workers(int num, ReadPipe<Read> in, WritePipe<Write> out) {
+    Workers(int num, ReadRing<Read> in, WriteRing<Write> out) {
 	while (num-- > 0) {
 	    worker_.emplace_back(new W(std::move(in.dup()),
 				       std::move(out.dup())));
 	}
     }
 
+    size_t size() const {
+	return worker_.size();
+    }
+
+    W & operator [](size_t i) {
+	return *worker_[i];
+    }
+
     ~Workers() {
 	for (typename std::vector<W *>::iterator it = worker_.begin();
 	     it != worker_.end(); ++it) {